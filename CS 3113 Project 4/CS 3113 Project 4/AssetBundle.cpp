@@ -0,0 +1,152 @@
+#include "AssetBundle.hpp"
+#include <stdio.h>
+#include <string.h>
+#ifdef _WINDOWS
+#include <stdlib.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char BUNDLE_MAGIC[4] = { 'A', 'B', 'N', 'D' };
+const unsigned int BUNDLE_VERSION = 1;
+const size_t BUNDLE_HEADER_SIZE = 16;
+
+static size_t align_up(size_t offset)
+{
+    return (offset + AssetBundle::ALIGNMENT - 1) / AssetBundle::ALIGNMENT * AssetBundle::ALIGNMENT;
+}
+
+AssetBundle::~AssetBundle()
+{
+    close();
+}
+
+bool AssetBundle::open(const char *filepath)
+{
+    close();
+
+#ifdef _WINDOWS
+    // No mmap here; read the file into one block instead
+    FILE *file = fopen(filepath, "rb");
+    if (file == NULL) return false;
+    fseek(file, 0, SEEK_END);
+    size_t size = (size_t) ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char *data = (unsigned char *) malloc(size);
+    bool ok = data != NULL && fread(data, 1, size, file) == size;
+    fclose(file);
+    if (!ok) { free(data); return false; }
+#else
+    int file = ::open(filepath, O_RDONLY);
+    if (file < 0) return false;
+
+    struct stat status;
+    if (fstat(file, &status) != 0 || status.st_size == 0) { ::close(file); return false; }
+    size_t size = (size_t) status.st_size;
+
+    // The mapping outlives the descriptor
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (mapping == MAP_FAILED) return false;
+    unsigned char *data = (unsigned char *) mapping;
+#endif
+
+    m_data = data;
+    m_size = size;
+
+    unsigned int version = 0, entry_count = 0;
+    bool valid = size >= BUNDLE_HEADER_SIZE && memcmp(data, BUNDLE_MAGIC, 4) == 0;
+    if (valid)
+    {
+        memcpy(&version, data + 4, sizeof(version));
+        memcpy(&entry_count, data + 8, sizeof(entry_count));
+        valid = version == BUNDLE_VERSION && BUNDLE_HEADER_SIZE + (size_t) entry_count * sizeof(Entry) <= size;
+    }
+
+    m_entries = (const Entry *) (data + BUNDLE_HEADER_SIZE);
+    m_entry_count = entry_count;
+
+    for (unsigned int i = 0; valid && i < entry_count; i++)
+    {
+        valid = m_entries[i].offset % ALIGNMENT == 0 && m_entries[i].offset <= size && m_entries[i].size <= size - m_entries[i].offset &&
+                memchr(m_entries[i].name, '\0', NAME_LENGTH) != NULL;
+    }
+
+    if (!valid) close();
+    return valid;
+}
+
+void AssetBundle::close()
+{
+    if (m_data == NULL) return;
+
+#ifdef _WINDOWS
+    free((void *) m_data);
+#else
+    munmap((void *) m_data, m_size);
+#endif
+
+    m_data = NULL;
+    m_size = 0;
+    m_entries = NULL;
+    m_entry_count = 0;
+}
+
+const AssetBundle::Entry *AssetBundle::find(const char *name, Kind kind) const
+{
+    for (unsigned int i = 0; i < m_entry_count; i++)
+    {
+        if (m_entries[i].kind == (unsigned int) kind && strcmp(m_entries[i].name, name) == 0) return &m_entries[i];
+    }
+    return NULL;
+}
+
+bool AssetBundleWriter::add(const std::string &name, AssetBundle::Kind kind, unsigned int width, unsigned int height,
+                            const void *data, size_t size)
+{
+    if (name.size() >= AssetBundle::NAME_LENGTH) return false;
+
+    AssetBundle::Entry entry;
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.name, name.c_str(), name.size());
+    entry.kind = kind;
+    entry.width = width;
+    entry.height = height;
+
+    // Offsets are relative to the data section until save() knows where that starts
+    entry.offset = align_up(m_data.size());
+    entry.size = size;
+    m_data.resize(entry.offset + size, 0);
+    memcpy(m_data.data() + entry.offset, data, size);
+
+    m_entries.push_back(entry);
+    return true;
+}
+
+bool AssetBundleWriter::save(const char *filepath) const
+{
+    FILE *file = fopen(filepath, "wb");
+    if (file == NULL) return false;
+
+    unsigned int entry_count = (unsigned int) m_entries.size();
+    size_t data_start = align_up(BUNDLE_HEADER_SIZE + m_entries.size() * sizeof(AssetBundle::Entry));
+
+    std::vector<AssetBundle::Entry> entries = m_entries;
+    for (AssetBundle::Entry &entry : entries) entry.offset += data_start;
+
+    unsigned char zeros[AssetBundle::ALIGNMENT] = { 0 };
+    size_t padding = data_start - BUNDLE_HEADER_SIZE - entries.size() * sizeof(AssetBundle::Entry);
+
+    bool ok = fwrite(BUNDLE_MAGIC, 1, 4, file) == 4 &&
+              fwrite(&BUNDLE_VERSION, sizeof(BUNDLE_VERSION), 1, file) == 1 &&
+              fwrite(&entry_count, sizeof(entry_count), 1, file) == 1 &&
+              fwrite(zeros, 1, 4, file) == 4 &&
+              fwrite(entries.data(), sizeof(AssetBundle::Entry), entries.size(), file) == entries.size() &&
+              fwrite(zeros, 1, padding, file) == padding &&
+              fwrite(m_data.data(), 1, m_data.size(), file) == m_data.size();
+
+    return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// A single file holding assets already in the form the game consumes: atlas pages as raw
+// RGBA, region rectangles, shader sources and level grids. --cook writes it; at start-up
+// it is memory-mapped, and entries are used in place without being copied or decoded.
+//
+// On disk: a header, the entry table, then each entry's data aligned to ALIGNMENT bytes.
+// The bundle isn't checked against its sources, so re-cook after changing any of them.
+class AssetBundle {
+public:
+    enum Kind { TEXTURE = 1, REGION = 2, SHADER = 3, LEVEL = 4 };
+
+    static const size_t ALIGNMENT = 64;
+    static const int NAME_LENGTH = 64;
+
+    struct Entry
+    {
+        char name[NAME_LENGTH];
+        unsigned int kind;
+        unsigned int width, height;
+        unsigned int reserved;
+        unsigned long long offset, size;
+    };
+
+private:
+    const unsigned char *m_data = NULL;
+    size_t m_size = 0;
+    const Entry *m_entries = NULL;
+    unsigned int m_entry_count = 0;
+
+public:
+    ~AssetBundle();
+
+    // Maps the file; returns false, leaving the bundle closed, if it is missing or malformed
+    bool open(const char *filepath);
+    void close();
+    bool const is_open() const { return m_data != NULL; }
+
+    // NULL when there is no entry with this name and kind
+    const Entry *find(const char *name, Kind kind) const;
+    const unsigned char *get_data(const Entry *entry) const { return m_data + entry->offset; }
+};
+
+// Collects entries in memory and writes them out as a bundle
+class AssetBundleWriter {
+private:
+    std::vector<AssetBundle::Entry> m_entries;
+    std::vector<unsigned char> m_data;
+
+public:
+    // Returns false if the name doesn't fit in an entry
+    bool add(const std::string &name, AssetBundle::Kind kind, unsigned int width, unsigned int height, const void *data, size_t size);
+    bool save(const char *filepath) const;
+};
+
+inline AssetBundle g_asset_bundle;
@@ -0,0 +1,681 @@
+#include "Benchmark.hpp"
+#ifdef _WINDOWS
+#include <GL/glew.h>
+#endif
+#include <SDL.h>
+#include <chrono>
+#include <iostream>
+#include <string.h>
+#include <math.h>
+#include "Entity.hpp"
+#include "SpatialGrid.hpp"
+#include "Collision.hpp"
+#include <vector>
+#include "Map.hpp"
+#include "RenderQueue.hpp"
+#include "RenderStats.hpp"
+#include "ParticleSystem.hpp"
+#include "ParticleKernels.hpp"
+#include "ProjectileSystem.hpp"
+#include <thread>
+#include <algorithm>
+
+#define LOG(argument) std::cout << argument << '\n'
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// A hidden window with a current GL context, for the benches that make GL calls. Without
+// one the calls go nowhere, or crash where the entry points are loaded (GLEW on Windows).
+class HiddenContext {
+private:
+    SDL_Window *m_window = NULL;
+    SDL_GLContext m_context = NULL;
+    
+public:
+    HiddenContext()
+    {
+        SDL_Init(SDL_INIT_VIDEO);
+        m_window = SDL_CreateWindow("Benchmark", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 64, 64,
+                                    SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+        if (m_window != NULL) m_context = SDL_GL_CreateContext(m_window);
+        if (m_context == NULL)
+        {
+            LOG("Couldn't create a GL context: " << SDL_GetError());
+            return;
+        }
+        SDL_GL_MakeCurrent(m_window, m_context);
+        
+#ifdef _WINDOWS
+        glewInit();
+#endif
+    }
+    
+    ~HiddenContext()
+    {
+        if (m_context != NULL) SDL_GL_DeleteContext(m_context);
+        if (m_window != NULL) SDL_DestroyWindow(m_window);
+        SDL_Quit();
+    }
+    
+    bool const is_valid() const { return m_context != NULL; }
+};
+
+// Scatters unit-sized entities over a square at constant density, so every
+// count sees about the same number of true neighbours per query.
+void scatter_entities(Entity *entities, int count)
+{
+    float side = sqrtf((float) count * 4.0f);
+    unsigned int seed = 12345;
+    for (int i = 0; i < count; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        float x = (float) (seed >> 8) / (float) (1 << 24) * side;
+        seed = seed * 1664525u + 1013904223u;
+        float y = (float) (seed >> 8) / (float) (1 << 24) * side;
+        
+        entities[i].set_position(glm::vec3(x, y, 0.0f));
+        entities[i].set_width(1.0f);
+        entities[i].set_height(1.0f);
+    }
+}
+
+// Linear scan versus SpatialGrid for "which entities overlap me", 3 to 100k entities.
+// The all-pairs columns extrapolate the per-query cost to every entity querying once.
+void bench_broadphase()
+{
+    const int COUNTS[] = { 3, 100, 1000, 10000, 100000 };
+    const int MAX_QUERIES = 1000;
+    
+    LOG("entities  rebuild_us  linear_ns/query  grid_ns/query  linear_all_pairs_ms  grid_all_pairs_ms");
+    for (int c = 0; c < (int) (sizeof(COUNTS) / sizeof(COUNTS[0])); c++)
+    {
+        int count = COUNTS[c];
+        Entity *entities = new Entity[count];
+        scatter_entities(entities, count);
+        
+        int queries = count < MAX_QUERIES ? count : MAX_QUERIES;
+        long hits_linear = 0;
+        long hits_grid = 0;
+        
+        Clock::time_point start = Clock::now();
+        for (int q = 0; q < queries; q++)
+        {
+            for (int i = 0; i < count; i++) hits_linear += entities[q].check_collision(&entities[i]);
+        }
+        double linear = seconds_since(start) / queries;
+        
+        SpatialGrid grid(1.0f);
+        start = Clock::now();
+        const int REBUILDS = 20;
+        for (int r = 0; r < REBUILDS; r++) grid.rebuild(entities, count);
+        double rebuild = seconds_since(start) / REBUILDS;
+        
+        start = Clock::now();
+        for (int q = 0; q < queries; q++)
+        {
+            glm::vec3 position = entities[q].get_position();
+            const std::vector<int> &candidates = grid.query(position.x - 0.5f, position.y - 0.5f, position.x + 0.5f, position.y + 0.5f);
+            for (int i = 0; i < (int) candidates.size(); i++) hits_grid += entities[q].check_collision(&entities[candidates[i]]);
+        }
+        double gridded = seconds_since(start) / queries;
+        
+        if (hits_linear != hits_grid) LOG("MISMATCH: linear found " << hits_linear << " overlaps, grid found " << hits_grid);
+        
+        LOG(count << "  " << rebuild * 1e6 << "  " << linear * 1e9 << "  " << gridded * 1e9 << "  "
+            << linear * count * 1e3 << "  " << (rebuild + gridded * count) * 1e3);
+        
+        delete [] entities;
+    }
+}
+
+// One box against N boxes: Entity::check_collision per pair, the scalar batch loop,
+// and the vectorised batch kernel.
+void bench_aabb()
+{
+    const int COUNTS[] = { 64, 1000, 10000, 100000 };
+    const int TOTAL_TESTS = 20000000;
+    
+    LOG("overlap_boxes compiled for " << overlap_boxes_isa());
+    LOG("boxes  entity_ns/box  scalar_ns/box  batch_ns/box  speedup_vs_entity  entity_hits");
+    for (int c = 0; c < (int) (sizeof(COUNTS) / sizeof(COUNTS[0])); c++)
+    {
+        int count = COUNTS[c];
+        int repeats = TOTAL_TESTS / count;
+        
+        Entity *entities = new Entity[count];
+        scatter_entities(entities, count);
+        std::vector<float> xs(count), ys(count), widths(count), heights(count);
+        for (int i = 0; i < count; i++)
+        {
+            xs[i] = entities[i].get_position().x;
+            ys[i] = entities[i].get_position().y;
+            widths[i] = entities[i].get_width();
+            heights[i] = entities[i].get_height();
+        }
+        std::vector<unsigned long long> scalar_hits((count + 63) / 64), batch_hits((count + 63) / 64);
+        
+        long entity_hits = 0;
+        Clock::time_point start = Clock::now();
+        for (int r = 0; r < repeats; r++)
+        {
+            Entity *probe = &entities[r % count];
+            for (int i = 0; i < count; i++) entity_hits += probe->check_collision(&entities[i]);
+        }
+        double entity = seconds_since(start) / ((double) repeats * count);
+        
+        start = Clock::now();
+        for (int r = 0; r < repeats; r++)
+        {
+            int p = r % count;
+            overlap_boxes_scalar(xs[p], ys[p], widths[p], heights[p], xs.data(), ys.data(), widths.data(), heights.data(), count, scalar_hits.data());
+        }
+        double scalar = seconds_since(start) / ((double) repeats * count);
+        
+        start = Clock::now();
+        for (int r = 0; r < repeats; r++)
+        {
+            int p = r % count;
+            overlap_boxes(xs[p], ys[p], widths[p], heights[p], xs.data(), ys.data(), widths.data(), heights.data(), count, batch_hits.data());
+        }
+        double batch = seconds_since(start) / ((double) repeats * count);
+        
+        if (scalar_hits != batch_hits) LOG("MISMATCH between scalar and batch results at " << count << " boxes");
+        
+        LOG(count << "  " << entity * 1e9 << "  " << scalar * 1e9 << "  " << batch * 1e9 << "  " << entity / batch << "x  "
+            << entity_hits);
+        
+        delete [] entities;
+    }
+}
+
+// Drops a box onto a one-tile-thick platform at increasing timesteps. Plain
+// integration tunnels once a step covers more than the platform plus the box;
+// the swept entity should land on top every time.
+void bench_sweep()
+{
+    const int WIDTH = 8, HEIGHT = 8;
+    unsigned int level_data[WIDTH * HEIGHT] = { 0 };
+    for (int x = 0; x < WIDTH; x++) level_data[5 * WIDTH + x] = 1;
+    Map map(WIDTH, HEIGHT, level_data, 1.0f);
+    
+    const float FALL_SPEED = -40.0f;
+    const float TIMESTEPS[] = { 1.0f / 240.0f, 1.0f / 60.0f, 1.0f / 30.0f, 1.0f / 15.0f };
+    
+    LOG("timestep  step_length  landed_y  tunneled");
+    for (int t = 0; t < (int) (sizeof(TIMESTEPS) / sizeof(TIMESTEPS[0])); t++)
+    {
+        Entity entity;
+        entity.set_entity_type(PLAYER);
+        entity.set_position(glm::vec3(3.0f, 2.0f, 0.0f));
+        entity.set_width(1.0f);
+        entity.set_height(1.0f);
+        entity.set_velocity(glm::vec3(0.0f, FALL_SPEED, 0.0f));
+        
+        for (int step = 0; step < 200 && !entity.m_map_bottom && !entity.game_over; step++)
+        {
+            entity.set_velocity(glm::vec3(0.0f, FALL_SPEED, 0.0f));
+            entity.update(TIMESTEPS[t], &entity, NULL, 0, &map);
+        }
+        
+        // The platform's top face is at y = -4.5, so a landed box sits at -4.0
+        float y = entity.get_position().y;
+        LOG(TIMESTEPS[t] << "  " << -FALL_SPEED * TIMESTEPS[t] << "  " << y << "  " << (y < -4.5f ? "yes" : "no"));
+    }
+    
+    const int QUERIES = 1000000;
+    int hits = 0;
+    Clock::time_point start = Clock::now();
+    for (int q = 0; q < QUERIES; q++)
+    {
+        float time_of_impact;
+        glm::vec3 normal;
+        float x = (float) (q % 700) / 100.0f;
+        hits += map.sweep_box(glm::vec3(x, 0.0f, 0.0f), 1.0f, 1.0f, glm::vec3(0.5f, -8.0f, 0.0f), &time_of_impact, &normal);
+    }
+    LOG("sweep_box: " << seconds_since(start) / QUERIES * 1e9 << " ns per 8-tile sweep (" << hits << " hits)");
+}
+
+// The float lookup Map::is_solid made before collision moved to bitmaps, reading the
+// level data directly, so the bench has an answer that doesn't share the Map's code
+bool reference_is_solid(const std::vector<unsigned int> &level_data, int width, int height, float tile_size, float x, float y)
+{
+    if (x < -(tile_size / 2) || x > (tile_size * width) - (tile_size / 2)) return false;
+    if (y > (tile_size / 2) || y < -(tile_size * height) + (tile_size / 2)) return false;
+    
+    int tile_x = floor((x + (tile_size / 2)) / tile_size);
+    int tile_y = -(ceil(y - (tile_size / 2))) / tile_size;
+    
+    if (tile_x < 0 || tile_x >= width) return false;
+    if (tile_y < 0 || tile_y >= height) return false;
+    return level_data[tile_y * width + tile_x] != 0;
+}
+
+// Random point probes through Map::is_solid versus the integer bitmap lookup, plus
+// row-span scans, on a wide, half-filled level. All three are checked against the
+// old float lookup and a plain scan of the level data.
+void bench_tiles()
+{
+    const int WIDTH = 4096, HEIGHT = 64;
+    std::vector<unsigned int> level_data(WIDTH * HEIGHT);
+    unsigned int seed = 777;
+    for (int i = 0; i < WIDTH * HEIGHT; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        level_data[i] = (seed >> 16) & 1;
+    }
+    Map map(WIDTH, HEIGHT, level_data.data(), 1.0f);
+    
+    const int PROBES = 10000000;
+    std::vector<float> xs(4096), ys(4096);
+    for (int i = 0; i < 4096; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        xs[i] = (float) (seed >> 8) / (float) (1 << 24) * WIDTH;
+        seed = seed * 1664525u + 1013904223u;
+        ys[i] = -(float) (seed >> 8) / (float) (1 << 24) * HEIGHT;
+    }
+    
+    long solid_float = 0;
+    Clock::time_point start = Clock::now();
+    for (int p = 0; p < PROBES; p++)
+    {
+        float penetration_x, penetration_y;
+        solid_float += map.is_solid(glm::vec3(xs[p & 4095], ys[p & 4095], 0.0f), &penetration_x, &penetration_y);
+    }
+    double is_solid = seconds_since(start) / PROBES;
+    
+    long solid_tile = 0;
+    start = Clock::now();
+    for (int p = 0; p < PROBES; p++)
+    {
+        solid_tile += map.is_solid_tile(map.tile_column(xs[p & 4095]), map.tile_row(ys[p & 4095]));
+    }
+    double is_solid_tile = seconds_since(start) / PROBES;
+    
+    long spans = 0;
+    start = Clock::now();
+    for (int p = 0; p < PROBES; p++)
+    {
+        int from = map.tile_column(xs[p & 4095]);
+        spans += map.first_solid_in_row(map.tile_row(ys[p & 4095]), from, from + 200) >= 0;
+    }
+    double span = seconds_since(start) / PROBES;
+    
+    // One pass over the distinct probes, outside the timed loops
+    int mismatches = 0;
+    for (int p = 0; p < 4096; p++)
+    {
+        bool expected = reference_is_solid(level_data, WIDTH, HEIGHT, 1.0f, xs[p], ys[p]);
+        float penetration_x, penetration_y;
+        if (map.is_solid(glm::vec3(xs[p], ys[p], 0.0f), &penetration_x, &penetration_y) != expected) mismatches++;
+        if (map.is_solid_tile(map.tile_column(xs[p]), map.tile_row(ys[p])) != expected) mismatches++;
+        
+        int from = map.tile_column(xs[p]), row = map.tile_row(ys[p]);
+        int first = -1;
+        for (int x = std::max(from, 0); x <= std::min(from + 200, WIDTH - 1) && first < 0 && row >= 0 && row < HEIGHT; x++)
+        {
+            if (level_data[row * WIDTH + x] != 0) first = x;
+        }
+        if (map.first_solid_in_row(row, from, from + 200) != first) mismatches++;
+    }
+    if (mismatches > 0) LOG("MISMATCH: " << mismatches << " probes disagree with the reference lookup");
+    if (solid_float != solid_tile) LOG("MISMATCH: is_solid found " << solid_float << " solid probes, is_solid_tile " << solid_tile);
+    LOG("is_solid: " << is_solid * 1e9 << " ns  is_solid_tile: " << is_solid_tile * 1e9 << " ns  first_solid_in_row (200 tiles): "
+        << span * 1e9 << " ns  (" << spans << " spans hit)");
+}
+
+// Walks a camera across a 100k-column level at running speed, streaming chunks as
+// it goes, and reports what stayed resident against the cost of meshing it all.
+void bench_chunks()
+{
+    HiddenContext context;
+    if (!context.is_valid()) return;
+    
+    const int WIDTH = 100000, HEIGHT = 16;
+    std::vector<unsigned int> level_data(WIDTH * HEIGHT, 0);
+    for (int x = 0; x < WIDTH; x++)
+    {
+        level_data[(HEIGHT - 1) * WIDTH + x] = 1;
+        if (x % 7 < 3) level_data[(HEIGHT - 5) * WIDTH + x] = 2;
+    }
+    
+    Clock::time_point start = Clock::now();
+    Map map(WIDTH, HEIGHT, level_data.data(), 0, 1.0f, 4, 1);
+    double build = seconds_since(start);
+    
+    size_t peak_bytes = 0;
+    int peak_count = 0;
+    int frames = 0;
+    start = Clock::now();
+    for (float camera_x = 0.0f; camera_x < WIDTH; camera_x += 3.0f * (1.0f / 60.0f) * 20.0f, frames++)
+    {
+        map.stream(camera_x - 5.0f, camera_x + 5.0f, 3.75f, -3.75f);
+        if (map.get_resident_chunk_bytes() > peak_bytes) peak_bytes = map.get_resident_chunk_bytes();
+        if (map.get_resident_chunk_count() > peak_count) peak_count = map.get_resident_chunk_count();
+    }
+    double walk = seconds_since(start);
+    
+    size_t full_mesh = (size_t) (WIDTH + WIDTH * 3 / 7) * 24 * sizeof(float);
+    LOG("Map " << WIDTH << "x" << HEIGHT << " built in " << build * 1e3 << " ms");
+    LOG("Streamed " << frames << " frames in " << walk * 1e3 << " ms (" << walk / frames * 1e6 << " us/frame): "
+        << map.get_chunk_loads() << " loads, " << map.get_chunk_evictions() << " evictions");
+    LOG("Peak resident: " << peak_count << " chunks, " << peak_bytes / 1024 << " KiB (whole-level mesh would be "
+        << full_mesh / 1024 << " KiB)");
+}
+
+// Edits tiles in view on ever wider maps, to show an edit costs the same at any width.
+// Swapping one tile id for another patches its quad; every 16th tick a tile is placed or
+// cleared as well, which re-meshes its chunk.
+void bench_edits()
+{
+    HiddenContext context;
+    if (!context.is_valid()) return;
+    
+    const int WIDTHS[] = { 1000, 10000, 100000 };
+    const int HEIGHT = 16, TICKS = 2000, EDITS_PER_TICK = 8;
+    
+    LOG("width   set_tile_ns  stream_us/tick  quads_patched  chunk_remeshes");
+    for (int w = 0; w < (int) (sizeof(WIDTHS) / sizeof(WIDTHS[0])); w++)
+    {
+        int width = WIDTHS[w];
+        std::vector<unsigned int> level_data(width * HEIGHT, 0);
+        for (int x = 0; x < width; x++) level_data[(HEIGHT - 1) * width + x] = 1;
+        
+        Map map(width, HEIGHT, level_data.data(), 0, 1.0f, 4, 1);
+        map.stream(-5.0f, 5.0f, 3.75f, -3.75f);
+        
+        double edit = 0.0, stream = 0.0;
+        for (int tick = 0; tick < TICKS; tick++)
+        {
+            Clock::time_point start = Clock::now();
+            for (int e = 0; e < EDITS_PER_TICK; e++)
+            {
+                int x = (tick + e * 3) % 10;
+                map.set_tile(x, HEIGHT - 1, map.get_tile(x, HEIGHT - 1) == 1 ? 2 : 1);
+            }
+            if (tick % 16 == 0) map.set_tile(tick % 10, HEIGHT - 3, (tick / 16) % 2 == 0 ? 3 : 0);
+            map.publish_edits();
+            edit += seconds_since(start);
+            
+            start = Clock::now();
+            map.stream(-5.0f, 5.0f, 3.75f, -3.75f);
+            stream += seconds_since(start);
+        }
+        
+        int edits = TICKS * EDITS_PER_TICK + TICKS / 16;
+        LOG(width << "  " << edit / edits * 1e9 << "  " << stream / TICKS * 1e6 << "  " << map.get_quads_patched() << "  " << map.get_edit_remeshes());
+    }
+}
+
+// Walks a camera over ever wider levels drawing the map both ways: streamed chunk meshes
+// and the tile-index texture under one quad. Reports the first frame (meshing the view,
+// or uploading the whole index), CPU time per frame after it (stream plus render), quads
+// submitted and the GPU memory each keeps for the level. GPU time isn't measured; the
+// texture path shades the pixels in view once per frame whatever the width, where the
+// mesh path's vertex work follows the tiles resident.
+void bench_tilemap()
+{
+    HiddenContext context;
+    if (!context.is_valid()) return;
+    
+    const int WIDTHS[] = { 100, 1000, 10000, 100000 };
+    const int HEIGHT = 16, FRAMES = 2000;
+    const float CAMERA_STEP = 3.0f * (1.0f / 60.0f) * 20.0f;
+    
+    // Each mode draws with the program the game gives it
+    ShaderProgram programs[2];
+    programs[Map::MESH].Load("shaders/vertex_textured.glsl", "shaders/fragment_textured.glsl");
+    programs[Map::TILE_TEXTURE].Load("shaders/vertex_tilemap.glsl", "shaders/fragment_tilemap.glsl");
+    
+    LOG("width   mesh_first_ms  mesh_us/frame  mesh_quads/frame  mesh_KiB (whole level)  texture_first_ms  texture_us/frame  texture_quads/frame  texture_KiB");
+    for (int w = 0; w < (int) (sizeof(WIDTHS) / sizeof(WIDTHS[0])); w++)
+    {
+        int width = WIDTHS[w];
+        std::vector<unsigned int> level_data(width * HEIGHT, 0);
+        for (int x = 0; x < width; x++)
+        {
+            level_data[(HEIGHT - 1) * width + x] = 1;
+            if (x % 7 < 3) level_data[(HEIGHT - 5) * width + x] = 2;
+        }
+        
+        double first[2], seconds[2];
+        long quads[2];
+        size_t peak_bytes[2] = { 0, 0 };
+        for (int mode = Map::MESH; mode <= Map::TILE_TEXTURE; mode++)
+        {
+            Map map(width, HEIGHT, level_data.data(), 0, 1.0f, 4, 1);
+            map.set_render_mode((Map::RenderMode) mode);
+            
+            Clock::time_point start = Clock::now();
+            map.stream(0.0f, 10.0f, 3.75f, -3.75f);
+            first[mode] = seconds_since(start);
+            
+            g_render_stats = RenderStats();
+            start = Clock::now();
+            for (int frame = 0; frame < FRAMES; frame++)
+            {
+                float camera_x = 5.0f + fmodf(frame * CAMERA_STEP, std::max(width - 10.0f, 1.0f));
+                map.stream(camera_x - 5.0f, camera_x + 5.0f, 3.75f, -3.75f);
+                map.render(&programs[mode], camera_x - 5.0f, camera_x + 5.0f);
+                
+                size_t bytes = mode == Map::MESH ? map.get_resident_chunk_bytes() : map.get_index_texture_bytes();
+                if (bytes > peak_bytes[mode]) peak_bytes[mode] = bytes;
+            }
+            seconds[mode] = seconds_since(start);
+            quads[mode] = g_render_stats.quads;
+        }
+        
+        size_t full_mesh = (size_t) (width + (width / 7) * 3 + std::min(width % 7, 3)) * 24 * sizeof(float);
+        LOG(width << "  " << first[Map::MESH] * 1e3 << "  " << seconds[Map::MESH] / FRAMES * 1e6 << "  " << quads[Map::MESH] / FRAMES << "  " << peak_bytes[Map::MESH] / 1024
+            << " (" << full_mesh / 1024 << ")  " << first[Map::TILE_TEXTURE] * 1e3 << "  " << seconds[Map::TILE_TEXTURE] / FRAMES * 1e6 << "  " << quads[Map::TILE_TEXTURE] / FRAMES
+            << "  " << peak_bytes[Map::TILE_TEXTURE] / 1024);
+    }
+    
+    programs[Map::MESH].Cleanup();
+    programs[Map::TILE_TEXTURE].Cleanup();
+}
+
+// Holds a pool at 100k live particles for ten simulated seconds at 60 Hz, topping it up
+// every frame as particles expire, and times the whole update (spawn, integrate,
+// compact) and the instance data render() builds for its single draw. The kernel is
+// also timed on its own against the scalar loop.
+void bench_particles()
+{
+    HiddenContext context;
+    if (!context.is_valid()) return;
+    
+    const int CAPACITY = 100000, FRAMES = 600;
+    const float FRAME_TIME = 1.0f / 60.0f;
+    
+    // The same sprite program the game picks: instanced where the driver allows it
+    ShaderProgram program;
+    bool instanced = SDL_GL_ExtensionSupported("GL_ARB_instanced_arrays") && SDL_GL_ExtensionSupported("GL_ARB_draw_instanced");
+    program.Load(instanced ? "shaders/vertex_instanced.glsl" : "shaders/vertex_textured.glsl", "shaders/fragment_textured.glsl");
+    
+    ParticleSystem particles;
+    ParticleEmitter emitter = { 1, 0.0f, 0.0f, 1.0f, 1.0f, 0.2f, 4.0f, 1.5708f, 3.1416f, 2.0f, -9.81f };
+    int pool = particles.add_emitter(emitter, CAPACITY);
+    
+    double update = 0.0, render = 0.0;
+    long live = 0, draws = 0;
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        particles.burst(pool, (float) (frame % 100), 0.0f, CAPACITY - particles.get_live_count());
+        particles.publish_bursts();
+        
+        Clock::time_point start = Clock::now();
+        particles.update(FRAME_TIME);
+        update += seconds_since(start);
+        live += particles.get_live_count();
+        
+        g_render_stats = RenderStats();
+        start = Clock::now();
+        particles.render(&program);
+        render += seconds_since(start);
+        draws += g_render_stats.draw_calls;
+    }
+    
+    program.Cleanup();
+    
+    LOG("integrate_particles compiled for " << integrate_particles_isa() << "; render " << (program.HasInstanceAttributes() ? "instanced" : "expanded on the CPU"));
+    LOG(live / FRAMES << " live on average: update " << update / FRAMES * 1e3 << " ms, render " << render / FRAMES * 1e3 << " ms, "
+        << (double) draws / FRAMES << " draws per frame (" << (update + render) / FRAMES / FRAME_TIME * 100.0 << "% of a 60 Hz frame); "
+        << particles.get_spawned() << " spawned, " << particles.get_expired() << " expired, " << particles.get_dropped() << " dropped");
+    
+    // Kernel alone: same start state through both paths, then the expiry masks must agree
+    std::vector<float> xs(CAPACITY), ys(CAPACITY), velocities_x(CAPACITY), velocities_y(CAPACITY), lives(CAPACITY), decays(CAPACITY);
+    for (int i = 0; i < CAPACITY; i++)
+    {
+        velocities_x[i] = (float) (i % 17) - 8.0f;
+        velocities_y[i] = (float) (i % 13);
+        lives[i] = 1.0f;
+        decays[i] = 0.5f + (float) (i % 97) / 16.0f;
+    }
+    std::vector<float> scalar_xs = xs, scalar_ys = ys, scalar_velocities_x = velocities_x, scalar_velocities_y = velocities_y, scalar_lives = lives;
+    std::vector<unsigned long long> scalar_expired((CAPACITY + 63) / 64), batch_expired((CAPACITY + 63) / 64);
+    
+    Clock::time_point start = Clock::now();
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        integrate_particles_scalar(scalar_xs.data(), scalar_ys.data(), scalar_velocities_x.data(), scalar_velocities_y.data(), scalar_lives.data(),
+                                   decays.data(), CAPACITY, -9.81f, FRAME_TIME / 8.0f, scalar_expired.data());
+    }
+    double scalar = seconds_since(start) / FRAMES;
+    
+    start = Clock::now();
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        integrate_particles(xs.data(), ys.data(), velocities_x.data(), velocities_y.data(), lives.data(), decays.data(), CAPACITY, -9.81f,
+                            FRAME_TIME / 8.0f, batch_expired.data());
+    }
+    double batch = seconds_since(start) / FRAMES;
+    
+    if (scalar_expired != batch_expired) LOG("MISMATCH between scalar and batch expiry");
+    LOG("integrate " << CAPACITY << " particles: scalar " << scalar * 1e3 << " ms, batch " << batch * 1e3 << " ms (" << scalar / batch << "x)");
+}
+
+// Keeps 10k bullets in flight for ten simulated seconds over a 1000-column level with a
+// wall every 50 columns and 1000 guards, refilling the pool every tick. Hit enemies come
+// back the next tick so there is always something to shoot.
+void bench_projectiles()
+{
+    const int WIDTH = 1000, HEIGHT = 16, ENEMIES = 1000, CAPACITY = 10000, TICKS = 600;
+    const float TICK = 1.0f / 60.0f;
+    
+    std::vector<unsigned int> level_data(WIDTH * HEIGHT, 0);
+    for (int x = 0; x < WIDTH; x++)
+    {
+        level_data[(HEIGHT - 1) * WIDTH + x] = 1;
+        if (x % 50 == 0) for (int y = HEIGHT - 6; y < HEIGHT - 1; y++) level_data[y * WIDTH + x] = 1;
+    }
+    Map map(WIDTH, HEIGHT, level_data.data(), 1.0f);
+    
+    Entity *enemies = new Entity[ENEMIES];
+    for (int i = 0; i < ENEMIES; i++)
+    {
+        enemies[i].set_position(glm::vec3((float) ((i * 7919) % (WIDTH * 100)) / 100.0f, -(float) (HEIGHT - 2 - i % 4), 0.0f));
+        enemies[i].set_width(1.0f);
+        enemies[i].set_height(1.0f);
+    }
+    SpatialGrid grid(map.get_tile_size());
+    
+    ProjectileSystem bullets(CAPACITY);
+    unsigned int seed = 4242;
+    double update = 0.0;
+    long live = 0;
+    for (int tick = 0; tick < TICKS; tick++)
+    {
+        while (bullets.get_live_count() < CAPACITY)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            float x = (float) (seed >> 8) / (float) (1 << 24) * WIDTH;
+            float direction = (seed & 1) ? 1.0f : -1.0f;
+            bullets.spawn(x, -(float) (HEIGHT - 2 - (seed >> 4) % 4), direction * 12.0f, 0.0f, 1.5f);
+        }
+        
+        grid.rebuild(enemies, ENEMIES);
+        Clock::time_point start = Clock::now();
+        bullets.update(TICK, &map, enemies, &grid);
+        update += seconds_since(start);
+        live += bullets.get_live_count();
+        
+        for (int i = 0; i < ENEMIES; i++)
+        {
+            if (!enemies[i].get_is_active())
+            {
+                enemies[i].activate();
+                enemies[i].set_dead(false);
+            }
+        }
+    }
+    
+    LOG(CAPACITY << " bullets vs " << ENEMIES << " enemies: " << update / TICKS * 1e3 << " ms per tick (" << update / TICKS / TICK * 100.0
+        << "% of a tick), " << live / TICKS << " live after update on average");
+    LOG(bullets.get_spawned() << " spawned, " << bullets.get_killed() << " killed: " << bullets.get_map_hits() << " by walls, "
+        << bullets.get_enemy_hits() << " by enemies, " << bullets.get_expired() << " expired; " << bullets.get_dropped() << " dropped");
+    
+    delete [] enemies;
+}
+
+// Submits 200k sprites over four textures at scattered depths from one and from four
+// threads, then sorts them.
+void bench_queue()
+{
+    const int SPRITES = 200000, THREADS = 4, ROUNDS = 20;
+    ShaderProgram program;
+    program.programID = 3;
+    
+    for (int threads = 1; threads <= THREADS; threads *= THREADS)
+    {
+        RenderQueue queue(threads);
+        double submit = 0.0, sort = 0.0;
+        
+        for (int round = 0; round < ROUNDS; round++)
+        {
+            queue.begin();
+            Clock::time_point start = Clock::now();
+            
+            auto submit_range = [&queue, &program, threads](int thread)
+            {
+                for (int i = thread; i < SPRITES; i += threads)
+                {
+                    queue.push_sprite(thread, &program, 1 + (i * 7) % 4, (float) ((i * 7919) % 1000), (float) i, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
+                }
+            };
+            std::vector<std::thread> workers;
+            for (int thread = 1; thread < threads; thread++) workers.emplace_back(submit_range, thread);
+            submit_range(0);
+            for (std::thread &worker : workers) worker.join();
+            submit += seconds_since(start);
+            
+            start = Clock::now();
+            queue.sort();
+            sort += seconds_since(start);
+        }
+        
+        LOG(threads << " submit thread(s): submit " << submit / ROUNDS * 1e3 << " ms, sort " << sort / ROUNDS * 1e3 << " ms for "
+            << queue.get_command_count() << " commands");
+    }
+}
+
+bool run_benchmark(const char *name)
+{
+    if (strcmp(name, "broadphase") == 0) { bench_broadphase(); return true; }
+    if (strcmp(name, "aabb") == 0) { bench_aabb(); return true; }
+    if (strcmp(name, "sweep") == 0) { bench_sweep(); return true; }
+    if (strcmp(name, "tiles") == 0) { bench_tiles(); return true; }
+    if (strcmp(name, "chunks") == 0) { bench_chunks(); return true; }
+    if (strcmp(name, "queue") == 0) { bench_queue(); return true; }
+    if (strcmp(name, "edits") == 0) { bench_edits(); return true; }
+    if (strcmp(name, "tilemap") == 0) { bench_tilemap(); return true; }
+    if (strcmp(name, "particles") == 0) { bench_particles(); return true; }
+    if (strcmp(name, "projectiles") == 0) { bench_projectiles(); return true; }
+    
+    LOG("Unknown benchmark " << name << ". Available: broadphase, aabb, sweep, tiles, chunks, queue, edits, tilemap, particles, projectiles");
+    return false;
+}
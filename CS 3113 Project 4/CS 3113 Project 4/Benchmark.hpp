@@ -0,0 +1,5 @@
+#pragma once
+
+// Micro-benchmarks for the simulation and rendering hot paths. The ones that make GL
+// calls open a hidden window for its context. Returns false if the name is unknown.
+bool run_benchmark(const char *name);
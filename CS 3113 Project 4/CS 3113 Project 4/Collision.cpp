@@ -0,0 +1,116 @@
+#include "Collision.hpp"
+#include <math.h>
+#include <string.h>
+
+// Only this file and ParticleKernels.cpp opt in to intrinsics; neither touches glm
+// types, so the rest of the build keeps its usual glm layout
+#define GLM_FORCE_INTRINSICS
+#include "glm/simd/platform.h"
+
+#if (GLM_ARCH & GLM_ARCH_NEON_BIT) && defined(__aarch64__)
+#define COLLISION_NEON
+#include <arm_neon.h>
+#endif
+
+static inline bool overlaps(float x, float y, float width, float height, float other_x, float other_y, float other_width, float other_height)
+{
+    float x_distance = fabsf(x - other_x) - ((width  + other_width)  / 2.0f);
+    float y_distance = fabsf(y - other_y) - ((height + other_height) / 2.0f);
+    
+    return x_distance < 0.0f && y_distance < 0.0f;
+}
+
+static void overlap_tail(float x, float y, float width, float height,
+                         const float *xs, const float *ys, const float *widths, const float *heights,
+                         int begin, int count, unsigned long long *hits)
+{
+    for (int i = begin; i < count; i++)
+    {
+        if (overlaps(x, y, width, height, xs[i], ys[i], widths[i], heights[i])) hits[i >> 6] |= 1ULL << (i & 63);
+    }
+}
+
+void overlap_boxes_scalar(float x, float y, float width, float height,
+                          const float *xs, const float *ys, const float *widths, const float *heights,
+                          int count, unsigned long long *hits)
+{
+    memset(hits, 0, sizeof(unsigned long long) * ((count + 63) / 64));
+    overlap_tail(x, y, width, height, xs, ys, widths, heights, 0, count, hits);
+}
+
+void overlap_boxes(float x, float y, float width, float height,
+                   const float *xs, const float *ys, const float *widths, const float *heights,
+                   int count, unsigned long long *hits)
+{
+    memset(hits, 0, sizeof(unsigned long long) * ((count + 63) / 64));
+    int i = 0;
+    
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 px = _mm256_set1_ps(x), py = _mm256_set1_ps(y);
+    const __m256 pw = _mm256_set1_ps(width), ph = _mm256_set1_ps(height);
+    
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 dx = _mm256_andnot_ps(sign, _mm256_sub_ps(px, _mm256_loadu_ps(xs + i)));
+        __m256 dy = _mm256_andnot_ps(sign, _mm256_sub_ps(py, _mm256_loadu_ps(ys + i)));
+        dx = _mm256_sub_ps(dx, _mm256_mul_ps(_mm256_add_ps(pw, _mm256_loadu_ps(widths + i)), half));
+        dy = _mm256_sub_ps(dy, _mm256_mul_ps(_mm256_add_ps(ph, _mm256_loadu_ps(heights + i)), half));
+        
+        __m256 hit = _mm256_and_ps(_mm256_cmp_ps(dx, zero, _CMP_LT_OQ), _mm256_cmp_ps(dy, zero, _CMP_LT_OQ));
+        hits[i >> 6] |= (unsigned long long) _mm256_movemask_ps(hit) << (i & 63);
+    }
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 px = _mm_set1_ps(x), py = _mm_set1_ps(y);
+    const __m128 pw = _mm_set1_ps(width), ph = _mm_set1_ps(height);
+    
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 dx = _mm_andnot_ps(sign, _mm_sub_ps(px, _mm_loadu_ps(xs + i)));
+        __m128 dy = _mm_andnot_ps(sign, _mm_sub_ps(py, _mm_loadu_ps(ys + i)));
+        dx = _mm_sub_ps(dx, _mm_mul_ps(_mm_add_ps(pw, _mm_loadu_ps(widths + i)), half));
+        dy = _mm_sub_ps(dy, _mm_mul_ps(_mm_add_ps(ph, _mm_loadu_ps(heights + i)), half));
+        
+        __m128 hit = _mm_and_ps(_mm_cmplt_ps(dx, zero), _mm_cmplt_ps(dy, zero));
+        hits[i >> 6] |= (unsigned long long) _mm_movemask_ps(hit) << (i & 63);
+    }
+#elif defined(COLLISION_NEON)
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t px = vdupq_n_f32(x), py = vdupq_n_f32(y);
+    const float32x4_t pw = vdupq_n_f32(width), ph = vdupq_n_f32(height);
+    const uint32_t lane_bits[4] = { 1, 2, 4, 8 };
+    const uint32x4_t bits = vld1q_u32(lane_bits);
+    
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t dx = vabsq_f32(vsubq_f32(px, vld1q_f32(xs + i)));
+        float32x4_t dy = vabsq_f32(vsubq_f32(py, vld1q_f32(ys + i)));
+        dx = vsubq_f32(dx, vmulq_f32(vaddq_f32(pw, vld1q_f32(widths + i)), half));
+        dy = vsubq_f32(dy, vmulq_f32(vaddq_f32(ph, vld1q_f32(heights + i)), half));
+        
+        uint32x4_t hit = vandq_u32(vcltq_f32(dx, zero), vcltq_f32(dy, zero));
+        hits[i >> 6] |= (unsigned long long) vaddvq_u32(vandq_u32(hit, bits)) << (i & 63);
+    }
+#endif
+    
+    overlap_tail(x, y, width, height, xs, ys, widths, heights, i, count, hits);
+}
+
+const char *overlap_boxes_isa()
+{
+#if GLM_ARCH & GLM_ARCH_AVX2_BIT
+    return "AVX2";
+#elif GLM_ARCH & GLM_ARCH_SSE2_BIT
+    return "SSE2";
+#elif defined(COLLISION_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
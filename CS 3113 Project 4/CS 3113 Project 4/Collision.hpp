@@ -0,0 +1,46 @@
+#pragma once
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit; `bits` must be non-zero
+inline int lowest_set_bit(unsigned long long bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int) index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+// Index of the highest set bit; `bits` must be non-zero
+inline int highest_set_bit(unsigned long long bits)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, bits);
+    return (int) index;
+#else
+    return 63 - __builtin_clzll(bits);
+#endif
+}
+
+// Batch AABB overlap test: one box against `count` boxes stored as separate
+// centre/size arrays. Bit i of `hits` (64 boxes per word) is set when box i
+// overlaps, using the same strict test as Entity::check_collision. `hits` must
+// hold (count + 63) / 64 words. Uses AVX2, SSE2 or NEON when the build has
+// them and a scalar loop otherwise.
+void overlap_boxes(float x, float y, float width, float height,
+                   const float *xs, const float *ys, const float *widths, const float *heights,
+                   int count, unsigned long long *hits);
+
+// The plain loop the vector paths must agree with; kept callable for benchmarks
+void overlap_boxes_scalar(float x, float y, float width, float height,
+                          const float *xs, const float *ys, const float *widths, const float *heights,
+                          int count, unsigned long long *hits);
+
+// Name of the instruction set overlap_boxes was compiled for
+const char *overlap_boxes_isa();
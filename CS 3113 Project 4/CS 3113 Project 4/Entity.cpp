@@ -21,21 +21,31 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include "ShaderProgram.h"
 #include "Entity.hpp"
+#include "RenderStats.hpp"
+#include "Replay.hpp"
+#include "PhysicsWorld.hpp"
+#include "Collision.hpp"
+#include <algorithm>
 
 Entity::Entity()
 {
-    m_position = glm::vec3(0.0f);
-    m_velocity = glm::vec3(0.0f);
-    m_acceleration = glm::vec3(0.0f);
+    m_entity_type = PLATFORM;
+    m_ai_type = GUARD;
+    m_ai_state = IDLE;
+    
+    m_body = PhysicsWorld::shared().allocate(this);
     
     m_movement = glm::vec3(0.0f);
     
     m_speed = 0;
     m_model_matrix = glm::mat4(1.0f);
+    m_previous_model_matrix = m_model_matrix;
 }
 
 Entity::~Entity()
 {
+    PhysicsWorld::shared().release(m_body);
+    
     delete [] m_animation_up;
     delete [] m_animation_down;
     delete [] m_animation_left;
@@ -43,8 +53,10 @@ Entity::~Entity()
     delete [] m_walking;
 }
 
-void Entity::draw_sprite_from_texture_atlas(ShaderProgram *program, GLuint texture_id, int index)
+glm::vec4 const Entity::sprite_rect(int index) const
 {
+    if (m_animation_indices == NULL) return m_texture_rect;
+    
     // Step 1: Calculate the UV location of the indexed frame
     float u_coord = (float) (index % m_animation_cols) / (float) m_animation_cols;
     float v_coord = (float) (index / m_animation_cols) / (float) m_animation_rows;
@@ -53,7 +65,17 @@ void Entity::draw_sprite_from_texture_atlas(ShaderProgram *program, GLuint textu
     float width = 1.0f / (float) m_animation_cols;
     float height = 1.0f / (float) m_animation_rows;
     
-    // Step 3: Just as we have done before, match the texture coordinates to the vertices
+    // Step 3: Move it to wherever the sheet was packed
+    return glm::vec4(m_texture_rect.x + u_coord * m_texture_rect.z, m_texture_rect.y + v_coord * m_texture_rect.w,
+                     width * m_texture_rect.z, height * m_texture_rect.w);
+}
+
+void Entity::draw_sprite_from_texture_atlas(ShaderProgram *program, GLuint texture_id, int index)
+{
+    glm::vec4 rect = sprite_rect(index);
+    float u_coord = rect.x, v_coord = rect.y, width = rect.z, height = rect.w;
+    
+    // Match the texture coordinates to the vertices
     float tex_coords[] =
     {
         u_coord, v_coord + height, u_coord + width, v_coord + height, u_coord + width, v_coord,
@@ -66,19 +88,17 @@ void Entity::draw_sprite_from_texture_atlas(ShaderProgram *program, GLuint textu
         -0.5, -0.5, 0.5,  0.5, -0.5, 0.5
     };
     
-    // Step 4: And render
-    glBindTexture(GL_TEXTURE_2D, texture_id);
+    // And render
+    g_gl_state.bind_texture(texture_id);
+    g_gl_state.bind_array_buffer(0);
+    g_gl_state.set_attributes(program->VertexAttributes());
     
     glVertexAttribPointer(program->positionAttribute, 2, GL_FLOAT, false, 0, vertices);
-    glEnableVertexAttribArray(program->positionAttribute);
-    
     glVertexAttribPointer(program->texCoordAttribute, 2, GL_FLOAT, false, 0, tex_coords);
-    glEnableVertexAttribArray(program->texCoordAttribute);
     
     glDrawArrays(GL_TRIANGLES, 0, 6);
-    
-    glDisableVertexAttribArray(program->positionAttribute);
-    glDisableVertexAttribArray(program->texCoordAttribute);
+    g_render_stats.draw_calls++;
+    g_render_stats.quads++;
 }
 
 void Entity::activate_ai(Entity *player)
@@ -106,16 +126,16 @@ void Entity::ai_guard(Entity *player)
 {
     switch (m_ai_state) {
         case IDLE:
-            if (glm::distance(m_position, player->get_position()) < 3.0f) m_ai_state = WALKING;
+            if (glm::distance(get_position(), player->get_position()) < 3.0f) m_ai_state = WALKING;
             break;
             
         case WALKING:
-            if (m_position.x > player->get_position().x) {
+            if (position_x() > player->get_position().x) {
                 m_movement = glm::vec3(-1.0f, 0.0f, 0.0f);
             } else {
                 m_movement = glm::vec3(1.0f, 0.0f, 0.0f);
             }
-            if (glm::distance(m_position, player->get_position()) > 3.0f) m_ai_state = IDLE;
+            if (glm::distance(get_position(), player->get_position()) > 3.0f) m_ai_state = IDLE;
             break;
             
         case ATTACKING:
@@ -129,7 +149,7 @@ void Entity::ai_guard(Entity *player)
 void Entity::ai_jump(Entity *player) {
     switch (m_ai_state) {
         case IDLE:
-            if (m_position.x > player->get_position().x) {
+            if (position_x() > player->get_position().x) {
                 m_movement = glm::vec3(-2.0f, 0.0f, 0.0f);
             }
             else {
@@ -147,20 +167,20 @@ void Entity::ai_jump(Entity *player) {
             jump_counter++;
             if (jump_counter > 200) {
                 jump_counter = 0;
-                m_acceleration = glm::vec3(0.0f, 0.0f, 0.0f);
+                set_acceleration(glm::vec3(0.0f, 0.0f, 0.0f));
                 m_ai_state = RESET;
             }
             else if (jump_counter > 100) {
-                m_acceleration = glm::vec3(0.0f, -9.81f - 1.0f, 0.0f);
+                set_acceleration(glm::vec3(0.0f, -9.81f - 1.0f, 0.0f));
             }
             break;
             
         case RESET:
-            if (m_position.y <= 3.0f) {
-                m_velocity = glm::vec3(0.0f, 2.0f, 0.0f);
+            if (position_y() <= 3.0f) {
+                set_velocity(glm::vec3(0.0f, 2.0f, 0.0f));
             }
             else {
-                m_velocity = glm::vec3(0.0f, 0.0f, 0.0f);
+                set_velocity(glm::vec3(0.0f, 0.0f, 0.0f));
                 m_ai_state = IDLE;
             }
             break;
@@ -171,40 +191,38 @@ void Entity::ai_jump(Entity *player) {
 }
 
 void Entity::ai_assassin(Entity* player) {
-    bool positive;
-    int counter;
     switch (m_ai_state) {
         case IDLE:
-            counter = 0;
-            if (glm::distance(m_position, player->get_position()) < 3.0f) {
+            reset_counter = 0;
+            if (glm::distance(get_position(), player->get_position()) < 3.0f) {
                 m_ai_state = ATTACKING;
-                if (m_position.x > player->get_position().x) {
+                if (position_x() > player->get_position().x) {
                     m_movement = glm::vec3(-5.0f, 0.0f, 0.0f);
-                    positive = false;
+                    attack_positive = false;
                 }
-                else if (m_position.x < player->get_position().x) {
+                else if (position_x() < player->get_position().x) {
                     m_movement = glm::vec3(5.0f, 0.0f, 0.0f);
-                    positive = true;
+                    attack_positive = true;
                 }
             }
             break;
             
         case ATTACKING:
-            if (positive and m_position.x > 24.0f) {
+            if (attack_positive and position_x() > 24.0f) {
                 m_movement = glm::vec3(-5.0f, 0.0f, 0.0f);
             }
-            else if (!positive and m_position.x < 16.0f) {
+            else if (!attack_positive and position_x() < 16.0f) {
                 m_movement = glm::vec3(5.0f, 0.0f, 0.0f);
             }
-            if (m_position.x == 20.0f) {
+            if (position_x() == 20.0f) {
                 m_ai_state = RESET;
                 m_movement = glm::vec3(0.0f, 0.0f, 0.0f);
             }
             break;
             
         case RESET:
-            counter++;
-            if (counter > 300) {
+            reset_counter++;
+            if (reset_counter > 300) {
                 m_ai_state = IDLE;
             }
         default:
@@ -212,9 +230,13 @@ void Entity::ai_assassin(Entity* player) {
     }
 }
 
-void Entity::update(float delta_time, Entity *player, Entity *objects, int object_count, Map *map)
+bool Entity::begin_update(float delta_time, Entity *player)
 {
-    if (!m_is_active) return;
+    // Entities that don't move this tick end it where they started
+    m_previous_model_matrix = m_model_matrix;
+    PhysicsWorld::shared().simulated[m_body] = 0.0f;
+    
+    if (!m_is_active) return false;
  
     m_enemy_top = false;
     m_enemy_bottom = false;
@@ -250,167 +272,298 @@ void Entity::update(float delta_time, Entity *player, Entity *objects, int objec
         }
     }
     
-    if (game_over == false) {
-        m_velocity.x = m_movement.x * m_speed;
-        
-        m_velocity += m_acceleration * delta_time;
-        
-        m_position.y += m_velocity.y * delta_time;
-        check_collision_y(objects, object_count);
-        check_collision_y(map);
-        
-        m_position.x += m_velocity.x * delta_time;
-        check_collision_x(objects, object_count);
-        check_collision_x(map);
-        
-        if (m_is_jumping)
-        {
-            m_is_jumping = false;
-            m_velocity.y += m_jumping_power;
-        }
-        
-        m_model_matrix = glm::mat4(1.0f);
-        m_model_matrix = glm::translate(m_model_matrix, m_position);
-        
-        if (m_position.y < -7.0f) {
-            game_over = true;
-        }
+    if (game_over == true) return false;
+    
+    // Hand the body to the integrators for this tick
+    velocity_x() = m_movement.x * m_speed;
+    PhysicsWorld::shared().simulated[m_body] = 1.0f;
+    return true;
+}
+
+void Entity::end_update()
+{
+    PhysicsWorld::shared().simulated[m_body] = 0.0f;
+    
+    if (m_is_jumping)
+    {
+        m_is_jumping = false;
+        velocity_y() += m_jumping_power;
+    }
+    
+    m_model_matrix = glm::mat4(1.0f);
+    m_model_matrix = glm::translate(m_model_matrix, get_position());
+    
+    if (position_y() < -7.0f) {
+        game_over = true;
+    }
 //        else if (m_enemy_top || m_enemy_left || m_enemy_right) {
 //            game_over = true;
 //        }
+}
+
+void Entity::update(float delta_time, Entity *player, Entity *objects, int object_count, Map *map, SpatialGrid *grid)
+{
+    if (!begin_update(delta_time, player)) return;
+    
+    PhysicsWorld &world = PhysicsWorld::shared();
+    
+    world.integrate_velocity(delta_time, m_body, m_body + 1);
+    
+    world.integrate_y(delta_time, m_body, m_body + 1);
+    sweep_collision_y(map);
+    bool use_grid = grid != NULL && object_count >= GRID_COLLISION_THRESHOLD;
+    if (use_grid) check_collision_y(objects, grid);
+    else check_collision_y(objects, object_count);
+    check_collision_y(map);
+    
+    world.integrate_x(delta_time, m_body, m_body + 1);
+    sweep_collision_x(map);
+    if (use_grid) check_collision_x(objects, grid);
+    else check_collision_x(objects, object_count);
+    check_collision_x(map);
+    
+    end_update();
+}
+
+void Entity::update_all(float delta_time, Entity *entities, int entity_count, Entity *player, Map *map)
+{
+    PhysicsWorld &world = PhysicsWorld::shared();
+    
+    // Bodies that sit out this tick stay masked off, so one pass covers the whole store
+    bool any_moving = false;
+    for (int i = 0; i < entity_count; i++) any_moving |= entities[i].begin_update(delta_time, player);
+    if (!any_moving) return;
+    
+    world.integrate_velocity(delta_time, 0, world.get_body_count());
+    world.integrate_y(delta_time, 0, world.get_body_count());
+    for (int i = 0; i < entity_count; i++)
+    {
+        if (world.simulated[entities[i].m_body] == 0.0f) continue;
+        entities[i].sweep_collision_y(map);
+        entities[i].check_collision_y(map);
     }
     
+    world.integrate_x(delta_time, 0, world.get_body_count());
+    for (int i = 0; i < entity_count; i++)
+    {
+        if (world.simulated[entities[i].m_body] == 0.0f) continue;
+        entities[i].sweep_collision_x(map);
+        entities[i].check_collision_x(map);
+        entities[i].end_update();
+    }
 }
 
 void const Entity::check_collision_y(Entity *collidable_entities, int collidable_entity_count)
 {
+    if (collidable_entity_count >= BATCH_COLLISION_THRESHOLD)
+    {
+        const std::vector<Entity *> &hits = find_overlaps(collidable_entities, collidable_entity_count);
+        for (int i = 0; i < (int) hits.size(); i++) resolve_collision_y(hits[i]);
+        return;
+    }
+    
     for (int i = 0; i < collidable_entity_count; i++)
     {
-        Entity *collidable_entity = &collidable_entities[i];
-        
-        if (check_collision(collidable_entity))
-        {
-            float y_distance = fabs(m_position.y - collidable_entity->get_position().y);
-            float y_overlap = fabs(y_distance - (m_height / 2.0f) - (collidable_entity->m_height / 2.0f));
-            if (m_position.y < collidable_entity->get_position().y) {
-                m_position.y -= y_overlap;
-                m_velocity.y = 0;
-                m_enemy_top = true;
-                game_over = true;
-            }
-            else if (m_position.y > collidable_entity->get_position().y) {
-                m_position.y += y_overlap;
-                m_velocity.y  = 0;
-                m_enemy_bottom = true;
-                collidable_entity->deactivate();
-                collidable_entity->dead = true;
-            }
-        }
+        resolve_collision_y(&collidable_entities[i]);
     }
 }
 
 void const Entity::check_collision_x(Entity *collidable_entities, int collidable_entity_count)
 {
+    if (collidable_entity_count >= BATCH_COLLISION_THRESHOLD)
+    {
+        const std::vector<Entity *> &hits = find_overlaps(collidable_entities, collidable_entity_count);
+        for (int i = 0; i < (int) hits.size(); i++) resolve_collision_x(hits[i]);
+        return;
+    }
+    
     for (int i = 0; i < collidable_entity_count; i++)
     {
-        Entity *collidable_entity = &collidable_entities[i];
-        
-        if (check_collision(collidable_entity))
-        {
-            float x_distance = fabs(m_position.x - collidable_entity->get_position().x);
-            float x_overlap = fabs(x_distance - (m_width / 2.0f) - (collidable_entity->get_width() / 2.0f));
-            if (m_velocity.x > 0) {
-                m_position.x     -= x_overlap;
-                m_velocity.x      = 0;
-                m_enemy_right  = true;
-                game_over = true;
-            } else if (m_velocity.x < 0) {
-                m_position.x    += x_overlap;
-                m_velocity.x     = 0;
-                m_enemy_left  = true;
-                game_over = true;
-            }
-        }
+        resolve_collision_x(&collidable_entities[i]);
     }
 }
 
-void const Entity::check_collision_y(Map *map)
+const std::vector<Entity *> &Entity::find_overlaps(Entity *collidable_entities, int collidable_entity_count) const
 {
-    // Probes for tiles
-    glm::vec3 top = glm::vec3(m_position.x, m_position.y + (m_height / 2), m_position.z);
-    glm::vec3 top_left = glm::vec3(m_position.x - (m_width / 2), m_position.y + (m_height / 2), m_position.z);
-    glm::vec3 top_right = glm::vec3(m_position.x + (m_width / 2), m_position.y + (m_height / 2), m_position.z);
+    static std::vector<unsigned long long> hit_bits;
+    static std::vector<Entity *> hits;
     
-    glm::vec3 bottom = glm::vec3(m_position.x, m_position.y - (m_height / 2), m_position.z);
-    glm::vec3 bottom_left = glm::vec3(m_position.x - (m_width / 2), m_position.y - (m_height / 2), m_position.z);
-    glm::vec3 bottom_right = glm::vec3(m_position.x + (m_width / 2), m_position.y - (m_height / 2), m_position.z);
+    PhysicsWorld &world = PhysicsWorld::shared();
+    hit_bits.resize((world.get_body_count() + 63) / 64);
+    hits.clear();
     
-    float penetration_x = 0;
-    float penetration_y = 0;
+    // One vectorised pass over every body, then keep the hits that belong to this array
+    world.overlap(position_x(), position_y(), width(), height(), hit_bits.data());
     
-    if (map->is_solid(top, &penetration_x, &penetration_y) && m_velocity.y > 0)
+    for (int word = 0; word < (int) hit_bits.size(); word++)
     {
-        m_position.y -= penetration_y;
-        m_velocity.y = 0;
-        m_map_top = true;
+        for (unsigned long long bits = hit_bits[word]; bits != 0; bits &= bits - 1)
+        {
+            Entity *owner = world.owner[word * 64 + lowest_set_bit(bits)];
+            if (owner >= collidable_entities && owner < collidable_entities + collidable_entity_count) hits.push_back(owner);
+        }
     }
-    else if (map->is_solid(top_left, &penetration_x, &penetration_y) && m_velocity.y > 0)
+    
+    // Resolve in array order, like the scalar loop
+    std::sort(hits.begin(), hits.end());
+    return hits;
+}
+
+void const Entity::check_collision_y(Entity *collidable_entities, SpatialGrid *grid)
+{
+    // Only the entities filed near us can overlap, so skip the rest of the array
+    const std::vector<int> &candidates = grid->query(position_x() - width() / 2.0f, position_y() - height() / 2.0f,
+                                                     position_x() + width() / 2.0f, position_y() + height() / 2.0f);
+    for (int i = 0; i < (int) candidates.size(); i++)
     {
-        m_position.y -= penetration_y;
-        m_velocity.y = 0;
-        m_map_top = true;
+        resolve_collision_y(&collidable_entities[candidates[i]]);
     }
-    else if (map->is_solid(top_right, &penetration_x, &penetration_y) && m_velocity.y > 0)
+}
+
+void const Entity::check_collision_x(Entity *collidable_entities, SpatialGrid *grid)
+{
+    const std::vector<int> &candidates = grid->query(position_x() - width() / 2.0f, position_y() - height() / 2.0f,
+                                                     position_x() + width() / 2.0f, position_y() + height() / 2.0f);
+    for (int i = 0; i < (int) candidates.size(); i++)
     {
-        m_position.y -= penetration_y;
-        m_velocity.y = 0;
-        m_map_top = true;
+        resolve_collision_x(&collidable_entities[candidates[i]]);
     }
-    
-    if (map->is_solid(bottom, &penetration_x, &penetration_y) && m_velocity.y < 0)
+}
+
+void const Entity::resolve_collision_y(Entity *collidable_entity)
+{
+    if (check_collision(collidable_entity))
     {
-        m_position.y += penetration_y;
-        m_velocity.y = 0;
-        m_map_bottom = true;
+        float y_distance = fabs(position_y() - collidable_entity->get_position().y);
+        float y_overlap = fabs(y_distance - (height() / 2.0f) - (collidable_entity->height() / 2.0f));
+        if (position_y() < collidable_entity->get_position().y) {
+            position_y() -= y_overlap;
+            velocity_y() = 0;
+            m_enemy_top = true;
+            game_over = true;
+        }
+        else if (position_y() > collidable_entity->get_position().y) {
+            position_y() += y_overlap;
+            velocity_y()  = 0;
+            m_enemy_bottom = true;
+            collidable_entity->deactivate();
+            collidable_entity->dead = true;
+        }
     }
-    else if (map->is_solid(bottom_left, &penetration_x, &penetration_y) && m_velocity.y < 0)
+}
+
+void const Entity::resolve_collision_x(Entity *collidable_entity)
+{
+    if (check_collision(collidable_entity))
     {
-            m_position.y += penetration_y;
-            m_velocity.y = 0;
-            m_map_bottom = true;
+        float x_distance = fabs(position_x() - collidable_entity->get_position().x);
+        float x_overlap = fabs(x_distance - (width() / 2.0f) - (collidable_entity->get_width() / 2.0f));
+        if (velocity_x() > 0) {
+            position_x()     -= x_overlap;
+            velocity_x()      = 0;
+            m_enemy_right  = true;
+            game_over = true;
+        } else if (velocity_x() < 0) {
+            position_x()    += x_overlap;
+            velocity_x()     = 0;
+            m_enemy_left  = true;
+            game_over = true;
+        }
+    }
+}
+
+void const Entity::check_collision_y(Map *map)
+{
+    // Every tile column under the box; the top and bottom edges each probe one row of them
+    int first_column = map->tile_column(position_x() - (width() / 2));
+    int last_column  = map->tile_column(position_x() + (width() / 2));
+    
+    if (velocity_y() > 0)
+    {
+        float top = position_y() + (height() / 2);
+        int row = map->tile_row(top);
+        
+        if (map->first_solid_in_row(row, first_column, last_column) >= 0)
+        {
+            position_y() -= (map->get_tile_size() / 2) - fabs(top - map->tile_center_y(row));
+            velocity_y() = 0;
+            m_map_top = true;
+        }
     }
-    else if (map->is_solid(bottom_right, &penetration_x, &penetration_y) && m_velocity.y < 0)
+    else if (velocity_y() < 0)
     {
-        m_position.y += penetration_y;
-        m_velocity.y = 0;
-        m_map_bottom = true;
+        float bottom = position_y() - (height() / 2);
+        int row = map->tile_row(bottom);
         
+        if (map->first_solid_in_row(row, first_column, last_column) >= 0)
+        {
+            position_y() += (map->get_tile_size() / 2) - fabs(bottom - map->tile_center_y(row));
+            velocity_y() = 0;
+            m_map_bottom = true;
+        }
     }
 }
 
 void const Entity::check_collision_x(Map *map)
 {
-    // Probes for tiles
-    glm::vec3 left = glm::vec3(m_position.x - (m_width / 2), m_position.y, m_position.z);
-    glm::vec3 right = glm::vec3(m_position.x + (m_width / 2), m_position.y, m_position.z);
+    int row = map->tile_row(position_y());
     
-    float penetration_x = 0;
-    float penetration_y = 0;
+    float left = position_x() - (width() / 2);
+    int left_column = map->tile_column(left);
     
-    if (map->is_solid(left, &penetration_x, &penetration_y) && m_velocity.x < 0)
+    if (velocity_x() < 0 && map->is_solid_tile(left_column, row))
     {
-        m_position.x += penetration_x;
-        m_velocity.x = 0;
+        position_x() += (map->get_tile_size() / 2) - fabs(left - map->tile_center_x(left_column));
+        velocity_x() = 0;
         m_map_left = true;
     }
-    if (map->is_solid(right, &penetration_x, &penetration_y) && m_velocity.x > 0)
+    
+    float right = position_x() + (width() / 2);
+    int right_column = map->tile_column(right);
+    
+    if (velocity_x() > 0 && map->is_solid_tile(right_column, row))
     {
-        m_position.x -= penetration_x;
-        m_velocity.x = 0;
+        position_x() -= (map->get_tile_size() / 2) - fabs(right - map->tile_center_x(right_column));
+        velocity_x() = 0;
         m_map_right = true;
     }
 }
 
+void const Entity::sweep_collision_y(Map *map)
+{
+    // Short moves can't skip a tile, and the probes in check_collision_y already cover them
+    float start_y = PhysicsWorld::shared().origin_y[m_body];
+    float displacement = position_y() - start_y;
+    if (fabs(displacement) < fmin(map->get_tile_size(), height()) / 2) return;
+    
+    float time_of_impact;
+    glm::vec3 normal;
+    if (!map->sweep_box(glm::vec3(position_x(), start_y, position_z()), width(), height(),
+                        glm::vec3(0.0f, displacement, 0.0f), &time_of_impact, &normal)) return;
+    
+    position_y() = start_y + displacement * time_of_impact;
+    velocity_y() = 0;
+    if (normal.y > 0) m_map_bottom = true;
+    else m_map_top = true;
+}
+
+void const Entity::sweep_collision_x(Map *map)
+{
+    float start_x = PhysicsWorld::shared().origin_x[m_body];
+    float displacement = position_x() - start_x;
+    if (fabs(displacement) < fmin(map->get_tile_size(), width()) / 2) return;
+    
+    float time_of_impact;
+    glm::vec3 normal;
+    if (!map->sweep_box(glm::vec3(start_x, position_y(), position_z()), width(), height(),
+                        glm::vec3(displacement, 0.0f, 0.0f), &time_of_impact, &normal)) return;
+    
+    position_x() = start_x + displacement * time_of_impact;
+    velocity_x() = 0;
+    if (normal.x > 0) m_map_left = true;
+    else m_map_right = true;
+}
+
 void Entity::render(ShaderProgram *program)
 {
     if (!m_is_active) return;
@@ -423,20 +576,59 @@ void Entity::render(ShaderProgram *program)
         return;
     }
     
+    float left = m_texture_rect.x, right = m_texture_rect.x + m_texture_rect.z;
+    float top = m_texture_rect.y, bottom = m_texture_rect.y + m_texture_rect.w;
+    
     float vertices[]   = { -0.5, -0.5, 0.5, -0.5, 0.5, 0.5, -0.5, -0.5, 0.5, 0.5, -0.5, 0.5 };
-    float tex_coords[] = {  0.0,  1.0, 1.0,  1.0, 1.0, 0.0,  0.0,  1.0, 1.0, 0.0,  0.0, 0.0 };
+    float tex_coords[] = { left, bottom, right, bottom, right, top, left, bottom, right, top, left, top };
     
-    glBindTexture(GL_TEXTURE_2D, m_texture_id);
+    g_gl_state.bind_texture(m_texture_id);
+    g_gl_state.bind_array_buffer(0);
+    g_gl_state.set_attributes(program->VertexAttributes());
     
     glVertexAttribPointer(program->positionAttribute, 2, GL_FLOAT, false, 0, vertices);
-    glEnableVertexAttribArray(program->positionAttribute);
     glVertexAttribPointer(program->texCoordAttribute, 2, GL_FLOAT, false, 0, tex_coords);
-    glEnableVertexAttribArray(program->texCoordAttribute);
     
     glDrawArrays(GL_TRIANGLES, 0, 6);
+    g_render_stats.draw_calls++;
+    g_render_stats.quads++;
+}
+
+bool Entity::snapshot(SpriteSnapshot &sprite) const
+{
+    if (!m_is_active) return false;
     
-    glDisableVertexAttribArray(program->positionAttribute);
-    glDisableVertexAttribArray(program->texCoordAttribute);
+    // The model matrix only ever translates and scales the unit quad
+    sprite.texture_id = m_texture_id;
+    sprite.depth = m_model_matrix[3][2];
+    sprite.x = m_model_matrix[3][0];
+    sprite.y = m_model_matrix[3][1];
+    sprite.previous_x = m_previous_model_matrix[3][0];
+    sprite.previous_y = m_previous_model_matrix[3][1];
+    sprite.scale_x = glm::length(glm::vec3(m_model_matrix[0]));
+    sprite.scale_y = glm::length(glm::vec3(m_model_matrix[1]));
+    sprite.uv = sprite_rect(m_animation_indices != NULL ? m_animation_indices[m_animation_index] : 0);
+    return true;
+}
+
+bool Entity::is_in_view(float left, float right, float top, float bottom)
+{
+    return position_x() + 0.5f > left && position_x() - 0.5f < right &&
+           position_y() - 0.5f < top  && position_y() + 0.5f > bottom;
+}
+
+glm::vec3 const Entity::get_acceleration() const
+{
+    PhysicsWorld &world = PhysicsWorld::shared();
+    return glm::vec3(world.acceleration_x[m_body], world.acceleration_y[m_body], world.acceleration_z[m_body]);
+}
+
+void const Entity::set_acceleration(glm::vec3 new_acceleration)
+{
+    PhysicsWorld &world = PhysicsWorld::shared();
+    world.acceleration_x[m_body] = new_acceleration.x;
+    world.acceleration_y[m_body] = new_acceleration.y;
+    world.acceleration_z[m_body] = new_acceleration.z;
 }
 
 bool const Entity::check_collision(Entity *other) const
@@ -445,8 +637,29 @@ bool const Entity::check_collision(Entity *other) const
     
     if (!m_is_active || !other->m_is_active) { return false; }
     
-    float x_distance = fabs(m_position.x - other->m_position.x) - ((m_width  + other->m_width)  / 2.0f);
-    float y_distance = fabs(m_position.y - other->m_position.y) - ((m_height + other->m_height) / 2.0f);
+    float x_distance = fabs(position_x() - other->position_x()) - ((width()  + other->width())  / 2.0f);
+    float y_distance = fabs(position_y() - other->position_y()) - ((height() + other->height()) / 2.0f);
     
     return x_distance < 0.0f && y_distance < 0.0f;
 }
+
+
+unsigned long long const Entity::hash_state(unsigned long long hash) const
+{
+    // Only simulation state goes in; rendering-only fields would make replays differ for no reason
+    hash = hash_bytes(hash, &m_is_active, sizeof(m_is_active));
+    hash = hash_bytes(hash, &m_ai_state, sizeof(m_ai_state));
+    glm::vec3 position = get_position();
+    glm::vec3 velocity = get_velocity();
+    glm::vec3 acceleration = get_acceleration();
+    hash = hash_bytes(hash, &position, sizeof(position));
+    hash = hash_bytes(hash, &velocity, sizeof(velocity));
+    hash = hash_bytes(hash, &acceleration, sizeof(acceleration));
+    hash = hash_bytes(hash, &m_movement, sizeof(m_movement));
+    hash = hash_bytes(hash, &dead, sizeof(dead));
+    hash = hash_bytes(hash, &jump_counter, sizeof(jump_counter));
+    hash = hash_bytes(hash, &attack_positive, sizeof(attack_positive));
+    hash = hash_bytes(hash, &reset_counter, sizeof(reset_counter));
+    hash = hash_bytes(hash, &game_over, sizeof(game_over));
+    return hash;
+}
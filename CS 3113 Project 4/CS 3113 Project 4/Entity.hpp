@@ -8,7 +8,11 @@
 * Academic Misconduct.
 **/
 
+#pragma once
 #include "Map.hpp"
+#include "SpatialGrid.hpp"
+#include "PhysicsWorld.hpp"
+#include "RenderSnapshot.hpp"
 
 enum EntityType { PLATFORM, PLAYER, ENEMY };
 enum AIType { GUARD, ASSASSIN, JUMPER };
@@ -27,24 +31,40 @@ private:
     int *m_animation_up = NULL;
     int *m_animation_down = NULL;
     
-    glm::vec3 m_position;
-    glm::vec3 m_velocity;
-    glm::vec3 m_acceleration;
+    // Position, velocity and acceleration live in PhysicsWorld; this is our slot there
+    int m_body;
     
-    float m_width = 0.8f;
-    float m_height = 0.8f;
+    float &position_x() const { return PhysicsWorld::shared().position_x[m_body]; }
+    float &position_y() const { return PhysicsWorld::shared().position_y[m_body]; }
+    float &position_z() const { return PhysicsWorld::shared().position_z[m_body]; }
+    float &velocity_x() const { return PhysicsWorld::shared().velocity_x[m_body]; }
+    float &velocity_y() const { return PhysicsWorld::shared().velocity_y[m_body]; }
+    float &width() const { return PhysicsWorld::shared().width[m_body]; }
+    float &height() const { return PhysicsWorld::shared().height[m_body]; }
+    
+    const std::vector<Entity *> &find_overlaps(Entity *collidable_entities, int collidable_entity_count) const;
     
     bool dead = false;
     int jump_counter = 0;
+    bool attack_positive = false;
+    int reset_counter = 0;
 public:
     static const int SECONDS_PER_FRAME = 4;
+    // Below this many collidable entities a plain loop beats the batch overlap test
+    static const int BATCH_COLLISION_THRESHOLD = 32;
+    // Below this many a grid query costs more than the batch test over every entity
+    static const int GRID_COLLISION_THRESHOLD = 512;
     static const int LEFT  = 0,
                      RIGHT = 1,
                      UP    = 2,
                      DOWN  = 3;
     
     GLuint m_texture_id;
+    // Where this entity's sheet sits inside m_texture_id: top-left u, v, then width, height
+    glm::vec4 m_texture_rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
     glm::mat4 m_model_matrix;
+    // m_model_matrix as of the tick before, so rendering can blend between the two
+    glm::mat4 m_previous_model_matrix;
     
     float m_speed;
     glm::vec3 m_movement;
@@ -75,8 +95,19 @@ public:
     ~Entity();
 
     void draw_sprite_from_texture_atlas(ShaderProgram *program, GLuint texture_id, int index);
-    void update(float delta_time, Entity *player, Entity *objects, int object_count, Map *map);
+    // UV rectangle of sheet cell `index` (or the whole sheet when not animated), within m_texture_rect
+    glm::vec4 const sprite_rect(int index) const;
+    bool begin_update(float delta_time, Entity *player);
+    void end_update();
+    void update(float delta_time, Entity *player, Entity *objects, int object_count, Map *map, SpatialGrid *grid = NULL);
+    // Same as calling update() on each entity with no collidable entities, but integrates them in one batch
+    static void update_all(float delta_time, Entity *entities, int entity_count, Entity *player, Map *map);
     void render(ShaderProgram *program);
+    // Copies out the sprite render() would draw, and where it was a tick earlier, so
+    // another thread can draw it later. Returns false for inactive entities.
+    bool snapshot(SpriteSnapshot &sprite) const;
+    // Whether the unit sprite quad render() draws overlaps the given view rectangle
+    bool is_in_view(float left, float right, float top, float bottom);
     void activate_ai(Entity *player);
     void ai_guard(Entity *player);
     void ai_jump(Entity *player);
@@ -84,36 +115,52 @@ public:
     
     void const check_collision_y(Entity *collidable_entities, int collidable_entity_count);
     void const check_collision_x(Entity *collidable_entities, int collidable_entity_count);
+    void const check_collision_y(Entity *collidable_entities, SpatialGrid *grid);
+    void const check_collision_x(Entity *collidable_entities, SpatialGrid *grid);
+    void const resolve_collision_y(Entity *collidable_entity);
+    void const resolve_collision_x(Entity *collidable_entity);
     void const check_collision_y(Map *map);
     void const check_collision_x(Map *map);
+    void const sweep_collision_y(Map *map);
+    void const sweep_collision_x(Map *map);
     
     bool const check_collision(Entity *other) const;
     
+    unsigned long long const hash_state(unsigned long long hash) const;
+    
     void activate() { m_is_active = true; };
     void deactivate() { m_is_active = false; };
     
     EntityType const get_entity_type() const { return m_entity_type; };
     AIType     const get_ai_type() const { return m_ai_type; };
     AIState    const get_ai_state() const { return m_ai_state; };
-    glm::vec3  const get_position() const { return m_position; };
+    glm::vec3  const get_position() const { return glm::vec3(position_x(), position_y(), position_z()); };
     glm::vec3  const get_movement() const { return m_movement; };
-    glm::vec3  const get_velocity() const { return m_velocity; };
-    glm::vec3  const get_acceleration() const { return m_acceleration; };
+    glm::vec3  const get_velocity() const { return glm::vec3(velocity_x(), velocity_y(), PhysicsWorld::shared().velocity_z[m_body]); };
+    glm::vec3  const get_acceleration() const;
     float      const get_jumping_power () const { return m_jumping_power; };
     float      const get_speed() const { return m_speed; };
-    int        const get_width() const { return m_width; };
-    int        const get_height() const { return m_height; };
+    float      const get_width() const { return width(); };
+    float      const get_height() const { return height(); };
     bool const get_dead() const { return dead; }
+    bool const get_is_active() const { return m_is_active; }
     
     void const set_entity_type(EntityType new_entity_type) { m_entity_type = new_entity_type; };
     void const set_ai_type(AIType new_ai_type) { m_ai_type = new_ai_type; };
     void const set_ai_state(AIState new_state) { m_ai_state = new_state; };
-    void const set_position(glm::vec3 new_position) { m_position = new_position; };
+    // Placing an entity moves it outright, with nothing to interpolate from
+    void const set_position(glm::vec3 new_position)
+    {
+        position_x() = new_position.x; position_y() = new_position.y; position_z() = new_position.z;
+        m_model_matrix = glm::translate(glm::mat4(1.0f), new_position);
+        m_previous_model_matrix = m_model_matrix;
+    };
     void const set_movement(glm::vec3 new_movement) { m_movement = new_movement; };
-    void const set_velocity(glm::vec3 new_velocity) { m_velocity = new_velocity; };
+    void const set_dead(bool new_dead) { dead = new_dead; };
+    void const set_velocity(glm::vec3 new_velocity) { velocity_x() = new_velocity.x; velocity_y() = new_velocity.y; PhysicsWorld::shared().velocity_z[m_body] = new_velocity.z; };
     void const set_speed(float new_speed) { m_speed = new_speed; };
     void const set_jumping_power(float new_jumping_power) { m_jumping_power = new_jumping_power; };
-    void const set_acceleration(glm::vec3 new_acceleration) { m_acceleration = new_acceleration; };
-    void const set_width(float new_width) { m_width = new_width; };
-    void const set_height(float new_height) { m_height = new_height; };
+    void const set_acceleration(glm::vec3 new_acceleration);
+    void const set_width(float new_width) { width() = new_width; };
+    void const set_height(float new_height) { height() = new_height; };
 };
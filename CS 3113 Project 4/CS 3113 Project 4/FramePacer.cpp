@@ -0,0 +1,73 @@
+#include "FramePacer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+FramePacer::FramePacer(double rate)
+{
+    set_rate(rate);
+}
+
+void FramePacer::set_rate(double rate)
+{
+    m_period = rate > 0.0 ? 1.0 / rate : 0.0;
+    m_started = false;
+}
+
+void FramePacer::wait()
+{
+    Clock::time_point now = Clock::now();
+    Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_period));
+
+    if (!m_started || now - m_next > period) m_next = now;
+    m_started = true;
+
+    wait_until(m_next);
+    m_next += period;
+}
+
+void FramePacer::wait_until(Clock::time_point deadline)
+{
+    Clock::time_point start = Clock::now();
+    Clock::time_point wake = deadline - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(SPIN_MARGIN));
+    if (wake > start) std::this_thread::sleep_until(wake);
+
+    Clock::time_point spin_start = Clock::now();
+    while (Clock::now() < deadline) std::this_thread::yield();
+
+    Clock::time_point now = Clock::now();
+    m_slept += std::chrono::duration<double>(spin_start - start).count();
+    m_spun += std::chrono::duration<double>(now - spin_start).count();
+
+    // Intervals are measured between the moments each wait returns
+    if (m_last_frame != Clock::time_point())
+    {
+        double interval = std::chrono::duration<double>(now - m_last_frame).count();
+        m_interval_sum += interval;
+        m_interval_sum_squares += interval * interval;
+        m_interval_min = m_frames == 0 ? interval : std::min(m_interval_min, interval);
+        m_interval_max = m_frames == 0 ? interval : std::max(m_interval_max, interval);
+        m_frames++;
+    }
+    m_last_frame = now;
+}
+
+PacingStats FramePacer::take_stats()
+{
+    PacingStats stats;
+    stats.frames = m_frames;
+    if (m_frames > 0)
+    {
+        double mean = m_interval_sum / m_frames;
+        stats.mean_ms = mean * 1e3;
+        stats.jitter_ms = std::sqrt(std::max(0.0, m_interval_sum_squares / m_frames - mean * mean)) * 1e3;
+        stats.worst_ms = std::max(m_interval_max - mean, mean - m_interval_min) * 1e3;
+    }
+    stats.slept_ms = m_slept * 1e3;
+    stats.spun_ms = m_spun * 1e3;
+
+    m_frames = 0;
+    m_interval_sum = m_interval_sum_squares = 0.0;
+    m_slept = m_spun = 0.0;
+    return stats;
+}
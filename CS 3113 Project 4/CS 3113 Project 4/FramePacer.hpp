@@ -0,0 +1,51 @@
+#pragma once
+#include <chrono>
+
+// Timing of the frames (or ticks) paced since the last take_stats()
+struct PacingStats
+{
+    long frames = 0;
+    double mean_ms = 0.0;
+    // Standard deviation of the interval between frames, and its largest deviation from the mean
+    double jitter_ms = 0.0;
+    double worst_ms = 0.0;
+    // Time spent blocked in sleep and spinning for the last stretch before each deadline
+    double slept_ms = 0.0;
+    double spun_ms = 0.0;
+};
+
+// Holds a loop to a target rate without busy-waiting the whole interval. wait() sleeps
+// until SPIN_MARGIN before the deadline, since OS sleeps overshoot by about that much,
+// then spins the rest of the way so frames land on time.
+class FramePacer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+private:
+    static constexpr double SPIN_MARGIN = 0.0015;
+
+    double m_period;
+    Clock::time_point m_next;
+    bool m_started = false;
+
+    Clock::time_point m_last_frame;
+    long m_frames = 0;
+    double m_interval_sum = 0.0, m_interval_sum_squares = 0.0;
+    double m_interval_min = 0.0, m_interval_max = 0.0;
+    double m_slept = 0.0, m_spun = 0.0;
+
+public:
+    // A rate of 0 leaves the loop uncapped, so wait() only records timing
+    FramePacer(double rate);
+
+    void set_rate(double rate);
+    double const get_rate() const { return m_period > 0.0 ? 1.0 / m_period : 0.0; }
+
+    // Blocks until the next frame is due. A loop that falls more than a frame behind
+    // starts over from now rather than rushing to catch up.
+    void wait();
+    // Blocks until the given time, with the same sleep-then-spin strategy
+    void wait_until(Clock::time_point deadline);
+
+    PacingStats take_stats();
+};
@@ -0,0 +1,76 @@
+#include "GLState.hpp"
+#include "RenderStats.hpp"
+
+// Until the first call, or after invalidate(), the real state is unknown, so put GL
+// back to its defaults and mirror those
+void GLState::sync()
+{
+    if (m_valid) return;
+    
+    glUseProgram(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for (GLuint attribute = 0; attribute < MAX_ATTRIBUTES; attribute++) glDisableVertexAttribArray(attribute);
+    
+    m_program = 0;
+    m_texture = 0;
+    m_array_buffer = 0;
+    m_attributes = 0;
+    m_valid = true;
+}
+
+void GLState::use_program(GLuint program_id)
+{
+    sync();
+    if (program_id == m_program) { g_render_stats.gl_calls_elided++; return; }
+    
+    glUseProgram(program_id);
+    m_program = program_id;
+    g_render_stats.gl_calls_issued++;
+}
+
+void GLState::bind_texture(GLuint texture_id)
+{
+    sync();
+    if (texture_id == m_texture) { g_render_stats.gl_calls_elided++; return; }
+    
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    m_texture = texture_id;
+    g_render_stats.gl_calls_issued++;
+}
+
+void GLState::bind_array_buffer(GLuint buffer)
+{
+    sync();
+    if (buffer == m_array_buffer) { g_render_stats.gl_calls_elided++; return; }
+    
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    m_array_buffer = buffer;
+    g_render_stats.gl_calls_issued++;
+}
+
+void GLState::set_attributes(unsigned int mask)
+{
+    sync();
+    unsigned int changed = mask ^ m_attributes;
+    if (changed == 0) { g_render_stats.gl_calls_elided++; return; }
+    
+    for (GLuint attribute = 0; attribute < MAX_ATTRIBUTES; attribute++)
+    {
+        unsigned int bit = 1u << attribute;
+        if (!(changed & bit)) continue;
+        
+        if (mask & bit) glEnableVertexAttribArray(attribute);
+        else glDisableVertexAttribArray(attribute);
+        g_render_stats.gl_calls_issued++;
+    }
+    m_attributes = mask;
+}
+
+void GLState::delete_buffer(GLuint buffer)
+{
+    if (buffer == 0) return;
+    
+    glDeleteBuffers(1, &buffer);
+    if (m_valid && buffer == m_array_buffer) m_array_buffer = 0;
+}
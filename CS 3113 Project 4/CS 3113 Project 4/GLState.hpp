@@ -0,0 +1,38 @@
+#pragma once
+#define GL_SILENCE_DEPRECATION
+#ifdef _WINDOWS
+#include <GL/glew.h>
+#endif
+#define GL_GLEXT_PROTOTYPES 1
+#include <SDL_opengl.h>
+
+// Mirrors the pieces of GL state the renderer changes between draws, so that calls
+// which would leave that state as it is are skipped. Issued and skipped calls are
+// counted in g_render_stats. All drawing code binds through here; anything that
+// changes this state behind its back must call invalidate() afterwards.
+class GLState {
+public:
+    // GL 2.1 guarantees at least this many vertex attributes
+    static const GLuint MAX_ATTRIBUTES = 16;
+    
+private:
+    GLuint m_program;
+    GLuint m_texture;
+    GLuint m_array_buffer;
+    unsigned int m_attributes; // Bit i set when vertex attribute array i is enabled
+    bool m_valid = false;
+    
+    void sync();
+    
+public:
+    void use_program(GLuint program_id);
+    void bind_texture(GLuint texture_id);
+    void bind_array_buffer(GLuint buffer);
+    // Enables exactly the vertex attribute arrays whose bits are set in `mask`
+    void set_attributes(unsigned int mask);
+    // Deletes the buffer and forgets it if it was the bound one
+    void delete_buffer(GLuint buffer);
+    void invalidate() { m_valid = false; }
+};
+
+inline GLState g_gl_state;
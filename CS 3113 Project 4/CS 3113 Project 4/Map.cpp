@@ -1,81 +1,583 @@
 #include "Map.hpp"
+#include "Collision.hpp"
+#include <algorithm>
+#include <string.h>
+#include "RenderStats.hpp"
 
-Map::Map(int width, int height, unsigned int *level_data, GLuint texture_id, float tile_size, int tile_count_x, int tile_count_y)
+Map::Map(int width, int height, const unsigned int *level_data, GLuint texture_id, float tile_size, int tile_count_x, int tile_count_y)
 {
     m_width = width;
     m_height = height;
     
-    m_level_data = level_data;
+    m_level_data.assign(level_data, level_data + width * height);
     m_texture_id = texture_id;
+    m_texture_rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
     
     m_tile_size = tile_size;
     m_tile_count_x = tile_count_x;
     m_tile_count_y = tile_count_y;
     
+    m_chunk_budget = DEFAULT_CHUNK_BUDGET;
+    m_resident_bytes = 0;
+    m_stream_count = 0;
+    m_chunk_loads = 0;
+    m_chunk_evictions = 0;
+    m_quads_patched = 0;
+    m_edit_remeshes = 0;
+    m_edit_count = 0;
+    m_edit_hash = HASH_SEED;
+    
+    m_render_mode = MESH;
+    m_index_texture = 0;
+    m_index_width = 0;
+    m_index_height = 0;
+    m_tilemap_program = 0;
+    
     build();
 }
 
+Map::Map(int width, int height, const unsigned int *level_data, float tile_size)
+{
+    m_width = width;
+    m_height = height;
+    
+    m_level_data.assign(level_data, level_data + width * height);
+    m_texture_id = 0;
+    m_texture_rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+    
+    m_tile_size = tile_size;
+    m_tile_count_x = 0;
+    m_tile_count_y = 0;
+    
+    m_chunk_count_x = 0;
+    m_chunk_count_y = 0;
+    m_chunk_budget = DEFAULT_CHUNK_BUDGET;
+    m_resident_bytes = 0;
+    m_stream_count = 0;
+    m_chunk_loads = 0;
+    m_chunk_evictions = 0;
+    m_quads_patched = 0;
+    m_edit_remeshes = 0;
+    m_edit_count = 0;
+    m_edit_hash = HASH_SEED;
+    
+    m_render_mode = MESH;
+    m_index_texture = 0;
+    m_index_width = 0;
+    m_index_height = 0;
+    m_tilemap_program = 0;
+    
+    build_bounds();
+    build_collision();
+}
+
+Map::~Map()
+{
+    for (Chunk &chunk : m_chunks)
+    {
+        g_gl_state.delete_buffer(chunk.buffer);
+    }
+    delete_index();
+}
+
 void Map::build()
 {
-    for(int y_coord = 0; y_coord < m_height; y_coord++)
+    // Meshes are built lazily by stream(); only the chunk table is set up here
+    m_chunk_count_x = (m_width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    m_chunk_count_y = (m_height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    for (Chunk &chunk : m_chunks)
     {
-        for(int x_coord = 0; x_coord < m_width; x_coord++) {
-            int tile = m_level_data[y_coord * m_width + x_coord];
+        g_gl_state.delete_buffer(chunk.buffer);
+    }
+    m_chunks.clear();
+    m_chunks.resize(m_chunk_count_x * m_chunk_count_y);
+    m_resident_chunks.clear();
+    m_resident_bytes = 0;
+    m_mesh_tiles = m_level_data;
+    delete_index();
+    
+    build_bounds();
+    build_collision();
+}
+
+void Map::mesh_chunk(int chunk_index)
+{
+    Chunk &chunk = m_chunks[chunk_index];
+    int first_x = (chunk_index % m_chunk_count_x) * CHUNK_SIZE;
+    int first_y = (chunk_index / m_chunk_count_x) * CHUNK_SIZE;
+    int last_x = std::min(first_x + CHUNK_SIZE, m_width);
+    int last_y = std::min(first_y + CHUNK_SIZE, m_height);
+    
+    m_mesh_scratch.clear();
+    
+    // Column-major, so any run of columns is one contiguous vertex range for render()
+    for(int x_coord = first_x; x_coord < last_x; x_coord++)
+    {
+        chunk.column_starts[x_coord - first_x] = (int) m_mesh_scratch.size() / FLOATS_PER_VERTEX;
+        
+        for(int y_coord = first_y; y_coord < last_y; y_coord++) {
+            unsigned int tile = m_mesh_tiles[y_coord * m_width + x_coord];
             
             if (tile == 0) continue;
             
-            float u_coord = (float) (tile % m_tile_count_x) / (float) m_tile_count_x;
-            float v_coord = (float) (tile / m_tile_count_x) / (float) m_tile_count_y;
-            
-            float tile_width = 1.0f/ (float)  m_tile_count_x;
-            float tile_height = 1.0f/ (float) m_tile_count_y;
-            
-            float x_offset = -(m_tile_size / 2); // From center of tile
-            float y_offset =  (m_tile_size / 2); // From center of tile
-            
-            m_vertices.insert(m_vertices.end(), {
-                x_offset + (m_tile_size * x_coord),  y_offset +  -m_tile_size * y_coord,
-                x_offset + (m_tile_size * x_coord),  y_offset + (-m_tile_size * y_coord) - m_tile_size,
-                x_offset + (m_tile_size * x_coord) + m_tile_size, y_offset + (-m_tile_size * y_coord) - m_tile_size,
-                x_offset + (m_tile_size * x_coord), y_offset + -m_tile_size * y_coord,
-                x_offset + (m_tile_size * x_coord) + m_tile_size, y_offset + (-m_tile_size * y_coord) - m_tile_size,
-                x_offset + (m_tile_size * x_coord) + m_tile_size, y_offset +  -m_tile_size * y_coord
-            });
-            
-            m_texture_coordinates.insert(m_texture_coordinates.end(), {
-                u_coord, v_coord,
-                u_coord, v_coord + (tile_height),
-                u_coord + tile_width, v_coord + (tile_height),
-                u_coord, v_coord,
-                u_coord + tile_width, v_coord + (tile_height),
-                u_coord + tile_width, v_coord
-            });
+            m_mesh_scratch.resize(m_mesh_scratch.size() + FLOATS_PER_QUAD);
+            write_quad(&m_mesh_scratch[m_mesh_scratch.size() - FLOATS_PER_QUAD], x_coord, y_coord, tile);
         }
     }
     
+    int vertex_count = (int) m_mesh_scratch.size() / FLOATS_PER_VERTEX;
+    for (int column = last_x - first_x; column <= CHUNK_SIZE; column++) chunk.column_starts[column] = vertex_count;
+    size_t bytes = m_mesh_scratch.size() * sizeof(float);
+    
+    if (vertex_count > 0)
+    {
+        if (chunk.buffer == 0) glGenBuffers(1, &chunk.buffer);
+        g_gl_state.bind_array_buffer(chunk.buffer);
+        
+        // Same size means the storage can be reused in place
+        if (vertex_count == chunk.vertex_count) glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, m_mesh_scratch.data());
+        else glBufferData(GL_ARRAY_BUFFER, bytes, m_mesh_scratch.data(), GL_STATIC_DRAW);
+        
+        g_render_stats.bytes_uploaded += bytes;
+    }
+    
+    m_resident_bytes -= chunk.vertex_count * FLOATS_PER_VERTEX * sizeof(float);
+    m_resident_bytes += bytes;
+    chunk.vertex_count = vertex_count;
+    chunk.dirty = false;
+}
+
+void Map::write_quad(float *target, int tile_x, int tile_y, unsigned int tile) const
+{
+    float u_coord = m_texture_rect.x + (float) (tile % m_tile_count_x) / (float) m_tile_count_x * m_texture_rect.z;
+    float v_coord = m_texture_rect.y + (float) (tile / m_tile_count_x) / (float) m_tile_count_y * m_texture_rect.w;
+    
+    float tile_width = m_texture_rect.z / (float)  m_tile_count_x;
+    float tile_height = m_texture_rect.w / (float) m_tile_count_y;
+    
+    float left   = -(m_tile_size / 2) + (m_tile_size * tile_x);
+    float top    =  (m_tile_size / 2) + (-m_tile_size * tile_y);
+    float right  = left + m_tile_size;
+    float bottom = top - m_tile_size;
+    
+    const float quad[FLOATS_PER_QUAD] = {
+        left,  top,    u_coord,              v_coord,
+        left,  bottom, u_coord,              v_coord + tile_height,
+        right, bottom, u_coord + tile_width, v_coord + tile_height,
+        left,  top,    u_coord,              v_coord,
+        right, bottom, u_coord + tile_width, v_coord + tile_height,
+        right, top,    u_coord + tile_width, v_coord
+    };
+    memcpy(target, quad, sizeof(quad));
+}
+
+void Map::load_chunk(int chunk_index)
+{
+    mesh_chunk(chunk_index);
+    
+    m_chunks[chunk_index].resident = true;
+    m_resident_chunks.push_back(chunk_index);
+    m_chunk_loads++;
+}
+
+void Map::evict_chunk(int chunk_index)
+{
+    Chunk &chunk = m_chunks[chunk_index];
+    m_resident_bytes -= chunk.vertex_count * FLOATS_PER_VERTEX * sizeof(float);
+    
+    g_gl_state.delete_buffer(chunk.buffer);
+    chunk.buffer = 0;
+    chunk.vertex_count = 0;
+    chunk.resident = false;
+    chunk.dirty = false;
+    
+    m_resident_chunks.erase(std::find(m_resident_chunks.begin(), m_resident_chunks.end(), chunk_index));
+    m_chunk_evictions++;
+}
+
+void Map::set_texture(GLuint texture_id, glm::vec4 texture_rect)
+{
+    m_texture_id = texture_id;
+    m_texture_rect = texture_rect;
+    
+    for (int chunk_index : m_resident_chunks) m_chunks[chunk_index].dirty = true;
+}
+
+bool Map::set_tile(int tile_x, int tile_y, unsigned int tile)
+{
+    if ((unsigned int) tile_x >= (unsigned int) m_width || (unsigned int) tile_y >= (unsigned int) m_height) return false;
+    
+    unsigned int &level_tile = m_level_data[tile_y * m_width + tile_x];
+    if (level_tile == tile) return true;
+    level_tile = tile;
+    
+    m_edit_count++;
+    m_edit_hash = hash_bytes(m_edit_hash, &tile_x, sizeof(tile_x));
+    m_edit_hash = hash_bytes(m_edit_hash, &tile_y, sizeof(tile_y));
+    m_edit_hash = hash_bytes(m_edit_hash, &tile, sizeof(tile));
+    
+    unsigned long long row_bit = 1ULL << (tile_x & 63);
+    unsigned long long column_bit = 1ULL << (tile_y & 63);
+    unsigned long long &row_word = m_solid_rows[tile_y * m_row_words + (tile_x >> 6)];
+    unsigned long long &column_word = m_solid_columns[tile_x * m_column_words + (tile_y >> 6)];
+    
+    if (tile != 0)
+    {
+        row_word |= row_bit;
+        column_word |= column_bit;
+    }
+    else
+    {
+        row_word &= ~row_bit;
+        column_word &= ~column_bit;
+    }
+    
+    // Collision-only maps have no mesh to keep in step
+    if (!m_chunks.empty()) m_tick_edits.push_back({ tile_x, tile_y, tile });
+    return true;
+}
+
+unsigned long long const Map::hash_state(unsigned long long hash) const
+{
+    if (m_edit_count == 0) return hash;
+    
+    hash = hash_bytes(hash, &m_edit_count, sizeof(m_edit_count));
+    hash = hash_bytes(hash, &m_edit_hash, sizeof(m_edit_hash));
+    return hash;
+}
+
+void Map::publish_edits()
+{
+    if (m_tick_edits.empty()) return;
+    
+    std::lock_guard<std::mutex> lock(m_edit_mutex);
+    m_queued_edits.insert(m_queued_edits.end(), m_tick_edits.begin(), m_tick_edits.end());
+    m_tick_edits.clear();
+}
+
+void Map::apply_edits()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_edit_mutex);
+        if (m_queued_edits.empty()) return;
+        m_applying_edits.swap(m_queued_edits);
+    }
+    
+    // The index texture is written through unit 1, so unit 0 keeps the binding GLState expects
+    if (m_index_width != 0)
+    {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, m_index_texture);
+    }
+    
+    for (const TileEdit &edit : m_applying_edits)
+    {
+        int tile_index = edit.y * m_width + edit.x;
+        unsigned int &mesh_tile = m_mesh_tiles[tile_index];
+        unsigned int previous = mesh_tile;
+        mesh_tile = edit.tile;
+        
+        if (m_index_width != 0 && previous != edit.tile)
+        {
+            const unsigned char texel[4] = { (unsigned char) (edit.tile & 255), (unsigned char) ((edit.tile >> 8) & 255), 0, 0 };
+            glTexSubImage2D(GL_TEXTURE_2D, 0, tile_index % m_index_width, tile_index / m_index_width, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+            g_render_stats.bytes_uploaded += sizeof(texel);
+        }
+        
+        // Chunks that aren't resident mesh from m_mesh_tiles when they load
+        Chunk &chunk = m_chunks[(edit.y / CHUNK_SIZE) * m_chunk_count_x + (edit.x / CHUNK_SIZE)];
+        if (!chunk.resident || chunk.dirty || previous == edit.tile) continue;
+        
+        // Adding or removing a quad shifts everything meshed after it
+        if (previous == 0 || edit.tile == 0)
+        {
+            chunk.dirty = true;
+            m_edit_remeshes++;
+            continue;
+        }
+        
+        // Otherwise the quad keeps its slot: the column's first vertex plus one quad per
+        // tile above it in the chunk
+        int first_y = (edit.y / CHUNK_SIZE) * CHUNK_SIZE;
+        int quad_index = 0;
+        for (int y_coord = first_y; y_coord < edit.y; y_coord++)
+        {
+            if (m_mesh_tiles[y_coord * m_width + edit.x] != 0) quad_index++;
+        }
+        int first_vertex = chunk.column_starts[edit.x % CHUNK_SIZE] + quad_index * 6;
+        
+        float quad[FLOATS_PER_QUAD];
+        write_quad(quad, edit.x, edit.y, edit.tile);
+        g_gl_state.bind_array_buffer(chunk.buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) first_vertex * FLOATS_PER_VERTEX * sizeof(float), sizeof(quad), quad);
+        
+        g_render_stats.bytes_uploaded += sizeof(quad);
+        m_quads_patched++;
+    }
+    m_applying_edits.clear();
+    
+    if (m_index_width != 0) glActiveTexture(GL_TEXTURE0);
+}
+
+void Map::upload_index()
+{
+    int tile_count = m_width * m_height;
+    m_index_width = std::min(tile_count, INDEX_ROW_LENGTH);
+    m_index_height = (tile_count + m_index_width - 1) / m_index_width;
+    
+    // Ids past 65535 don't fit in two bytes; the tilesets here are far smaller
+    std::vector<unsigned char> texels((size_t) m_index_width * m_index_height * 4, 0);
+    for (int tile_index = 0; tile_index < tile_count; tile_index++)
+    {
+        texels[tile_index * 4]     = (unsigned char) (m_mesh_tiles[tile_index] & 255);
+        texels[tile_index * 4 + 1] = (unsigned char) ((m_mesh_tiles[tile_index] >> 8) & 255);
+    }
+    
+    glGenTextures(1, &m_index_texture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_index_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_index_width, m_index_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    
+    // Ids must come back exactly, never blended with a neighbour's
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
+    
+    g_render_stats.bytes_uploaded += texels.size();
+}
+
+void Map::delete_index()
+{
+    if (m_index_texture != 0) glDeleteTextures(1, &m_index_texture);
+    m_index_texture = 0;
+    m_index_width = 0;
+    m_index_height = 0;
+}
+
+void Map::set_render_mode(RenderMode mode)
+{
+    if (mode == m_render_mode) return;
+    m_render_mode = mode;
+    
+    if (mode == TILE_TEXTURE)
+    {
+        while (!m_resident_chunks.empty()) evict_chunk(m_resident_chunks.back());
+    }
+    else delete_index();
+}
+
+void Map::stream(float left, float right, float top, float bottom)
+{
+    if (m_chunks.empty()) return;
+    
+    apply_edits();
+    m_stream_count++;
+    
+    // The whole level is one texture, so there is nothing to stream
+    if (m_render_mode == TILE_TEXTURE)
+    {
+        if (m_index_width == 0) upload_index();
+        return;
+    }
+    
+    float chunk_length = m_tile_size * CHUNK_SIZE;
+    int first_x = std::max((int) floorf((left - m_left_bound) / chunk_length) - STREAM_MARGIN, 0);
+    int last_x  = std::min((int) floorf((right - m_left_bound) / chunk_length) + STREAM_MARGIN, m_chunk_count_x - 1);
+    int first_y = std::max((int) floorf((m_top_bound - top) / chunk_length) - STREAM_MARGIN, 0);
+    int last_y  = std::min((int) floorf((m_top_bound - bottom) / chunk_length) + STREAM_MARGIN, m_chunk_count_y - 1);
+    
+    for (int chunk_y = first_y; chunk_y <= last_y; chunk_y++)
+    {
+        for (int chunk_x = first_x; chunk_x <= last_x; chunk_x++)
+        {
+            int chunk_index = chunk_y * m_chunk_count_x + chunk_x;
+            if (!m_chunks[chunk_index].resident) load_chunk(chunk_index);
+            else if (m_chunks[chunk_index].dirty) mesh_chunk(chunk_index);
+            m_chunks[chunk_index].last_wanted = m_stream_count;
+        }
+    }
+    
+    while (m_resident_bytes > m_chunk_budget)
+    {
+        int oldest = -1;
+        for (int chunk_index : m_resident_chunks)
+        {
+            if (m_chunks[chunk_index].last_wanted == m_stream_count) continue;
+            if (oldest < 0 || m_chunks[chunk_index].last_wanted < m_chunks[oldest].last_wanted) oldest = chunk_index;
+        }
+        if (oldest < 0) break;
+        
+        evict_chunk(oldest);
+    }
+    
+    // Edited chunks that fell out of range but are still resident re-upload as well
+    for (int chunk_index : m_resident_chunks)
+    {
+        if (m_chunks[chunk_index].dirty) mesh_chunk(chunk_index);
+    }
+}
+
+// First set bit met walking from `from` to `to` in a bit row of `length` bits, or -1
+static int first_set_in_span(const unsigned long long *words, int length, int from, int to)
+{
+    if (from <= to)
+    {
+        if (to < 0 || from >= length) return -1;
+        if (from < 0) from = 0;
+        if (to >= length) to = length - 1;
+        
+        int word = from >> 6;
+        unsigned long long bits = words[word] & (~0ULL << (from & 63));
+        while (true)
+        {
+            if (bits != 0)
+            {
+                int found = (word << 6) + lowest_set_bit(bits);
+                return found <= to ? found : -1;
+            }
+            if (++word > (to >> 6)) return -1;
+            bits = words[word];
+        }
+    }
+    
+    if (from < 0 || to >= length) return -1;
+    if (from >= length) from = length - 1;
+    if (to < 0) to = 0;
+    
+    int word = from >> 6;
+    unsigned long long bits = words[word] & (~0ULL >> (63 - (from & 63)));
+    while (true)
+    {
+        if (bits != 0)
+        {
+            int found = (word << 6) + highest_set_bit(bits);
+            return found >= to ? found : -1;
+        }
+        if (--word < (to >> 6)) return -1;
+        bits = words[word];
+    }
+}
+
+void Map::build_collision()
+{
+    m_inverse_tile_size = 1.0f / m_tile_size;
+    m_row_words = (m_width + 63) / 64;
+    m_column_words = (m_height + 63) / 64;
+    m_solid_rows.assign(m_row_words * m_height, 0);
+    m_solid_columns.assign(m_column_words * m_width, 0);
+    
+    for (int y_coord = 0; y_coord < m_height; y_coord++)
+    {
+        for (int x_coord = 0; x_coord < m_width; x_coord++)
+        {
+            if (m_level_data[y_coord * m_width + x_coord] == 0) continue;
+            
+            m_solid_rows[y_coord * m_row_words + (x_coord >> 6)] |= 1ULL << (x_coord & 63);
+            m_solid_columns[x_coord * m_column_words + (y_coord >> 6)] |= 1ULL << (y_coord & 63);
+        }
+    }
+}
+
+void Map::build_bounds()
+{
     m_left_bound   = 0 - (m_tile_size / 2);
     m_right_bound  = (m_tile_size * m_width) - (m_tile_size / 2);
     m_top_bound    = 0 + (m_tile_size / 2);
     m_bottom_bound = -(m_tile_size * m_height) + (m_tile_size / 2);
 }
 
-void Map::render(ShaderProgram *program)
+void Map::render(ShaderProgram *program, float left, float right)
+{
+    if (m_render_mode == TILE_TEXTURE)
+    {
+        render_tile_texture(program, left, right);
+        return;
+    }
+    
+    glm::mat4 model_matrix = glm::mat4(1.0f);
+    program->SetModelMatrix(model_matrix);
+    
+    g_gl_state.bind_texture(m_texture_id);
+    g_gl_state.set_attributes(program->VertexAttributes());
+    
+    int first_column = tile_column(left);
+    int last_column = tile_column(right);
+    
+    GLsizei stride = FLOATS_PER_VERTEX * sizeof(float);
+    for (int chunk_index : m_resident_chunks)
+    {
+        Chunk &chunk = m_chunks[chunk_index];
+        if (chunk.vertex_count == 0) continue;
+        
+        int chunk_first_x = (chunk_index % m_chunk_count_x) * CHUNK_SIZE;
+        int from = std::clamp(first_column - chunk_first_x, 0, CHUNK_SIZE);
+        int to   = std::clamp(last_column - chunk_first_x + 1, 0, CHUNK_SIZE);
+        int first_vertex = chunk.column_starts[from];
+        int vertex_count = from < to ? chunk.column_starts[to] - first_vertex : 0;
+        
+        g_render_stats.quads_culled += (chunk.vertex_count - vertex_count) / 6;
+        if (vertex_count == 0) continue;
+        
+        g_gl_state.bind_array_buffer(chunk.buffer);
+        glVertexAttribPointer(program->positionAttribute, 2, GL_FLOAT, false, stride, (const void *) 0);
+        glVertexAttribPointer(program->texCoordAttribute, 2, GL_FLOAT, false, stride, (const void *) (2 * sizeof(float)));
+        glDrawArrays(GL_TRIANGLES, first_vertex, vertex_count);
+        
+        g_render_stats.draw_calls++;
+        g_render_stats.quads += vertex_count / 6;
+    }
+}
+
+void Map::render_tile_texture(ShaderProgram *program, float left, float right)
 {
+    // Only the part of the view the level covers needs fragments
+    float quad_left = std::max(left, m_left_bound);
+    float quad_right = std::min(right, m_right_bound);
+    if (m_index_width == 0 || quad_left >= quad_right) return;
+    
     glm::mat4 model_matrix = glm::mat4(1.0f);
     program->SetModelMatrix(model_matrix);
     
-    glUseProgram(program->programID);
+    if (program->programID != m_tilemap_program)
+    {
+        m_tilemap_program = program->programID;
+        m_map_origin_uniform = glGetUniformLocation(m_tilemap_program, "mapOrigin");
+        m_index_layout_uniform = glGetUniformLocation(m_tilemap_program, "indexLayout");
+        m_tile_count_uniform = glGetUniformLocation(m_tilemap_program, "tileCount");
+        m_tileset_rect_uniform = glGetUniformLocation(m_tilemap_program, "tilesetRect");
+        m_tile_index_uniform = glGetUniformLocation(m_tilemap_program, "tileIndex");
+    }
+    // Through the program's cache, so a frame after the first sends none of these
+    program->SetUniform(m_map_origin_uniform, 3, glm::vec4(m_left_bound, m_top_bound, m_inverse_tile_size, 0.0f));
+    program->SetUniform(m_index_layout_uniform, 3, glm::vec4((float) m_width, (float) m_index_width, (float) m_index_height, 0.0f));
+    program->SetUniform(m_tile_count_uniform, 2, glm::vec4((float) m_tile_count_x, (float) m_tile_count_y, 0.0f, 0.0f));
+    program->SetUniform(m_tileset_rect_uniform, 4, m_texture_rect);
+    program->SetSampler(m_tile_index_uniform, 1);
+    
+    g_gl_state.bind_texture(m_texture_id);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_index_texture);
+    glActiveTexture(GL_TEXTURE0);
     
-    glVertexAttribPointer(program->positionAttribute, 2, GL_FLOAT, false, 0, m_vertices.data());
-    glEnableVertexAttribArray(program->positionAttribute);
-    glVertexAttribPointer(program->texCoordAttribute, 2, GL_FLOAT, false, 0, m_texture_coordinates.data());
-    glEnableVertexAttribArray(program->texCoordAttribute);
+    const float quad[] = {
+        quad_left,  m_top_bound,
+        quad_left,  m_bottom_bound,
+        quad_right, m_bottom_bound,
+        quad_left,  m_top_bound,
+        quad_right, m_bottom_bound,
+        quad_right, m_top_bound
+    };
     
-    glBindTexture(GL_TEXTURE_2D, m_texture_id);
+    // Straight from client memory; there is no texCoord attribute in this shader
+    g_gl_state.bind_array_buffer(0);
+    g_gl_state.set_attributes(ShaderProgram::AttributeBit(program->positionAttribute));
+    glVertexAttribPointer(program->positionAttribute, 2, GL_FLOAT, false, 0, quad);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
     
-    glDrawArrays(GL_TRIANGLES, 0, (int) m_vertices.size() / 2);
-    glDisableVertexAttribArray(program->positionAttribute);
-    glDisableVertexAttribArray(program->texCoordAttribute);
+    g_render_stats.draw_calls++;
+    g_render_stats.quads++;
 }
 
 bool Map::is_solid(glm::vec3 position, float *penetration_x, float *penetration_y)
@@ -83,23 +585,117 @@ bool Map::is_solid(glm::vec3 position, float *penetration_x, float *penetration_
     *penetration_x = 0;
     *penetration_y = 0;
     
-    if (position.x < m_left_bound || position.x > m_right_bound)  return false;
-    if (position.y > m_top_bound  || position.y < m_bottom_bound) return false;
+    // Out-of-range indices (including everything past the bounds) read as empty
+    int tile_x = tile_column(position.x);
+    int tile_y = tile_row(position.y);
     
-    int tile_x = floor((position.x + (m_tile_size / 2))  / m_tile_size);
-    int tile_y = -(ceil(position.y - (m_tile_size / 2))) / m_tile_size; // Our array counts up as Y goes down.
+    if (!is_solid_tile(tile_x, tile_y)) return false;
     
-    if (tile_x < 0 || tile_x >= m_width)  return false;
-    if (tile_y < 0 || tile_y >= m_height) return false;
+    *penetration_x = (m_tile_size / 2) - fabs(position.x - tile_center_x(tile_x));
+    *penetration_y = (m_tile_size / 2) - fabs(position.y - tile_center_y(tile_y));
     
-    int tile = m_level_data[tile_y * m_width + tile_x];
-    if (tile == 0) return false;
+    return true;
+}
+
+int Map::first_solid_in_row(int tile_y, int from_x, int to_x) const
+{
+    if (tile_y < 0 || tile_y >= m_height) return -1;
+    return first_set_in_span(&m_solid_rows[tile_y * m_row_words], m_width, from_x, to_x);
+}
+
+int Map::first_solid_in_column(int tile_x, int from_y, int to_y) const
+{
+    if (tile_x < 0 || tile_x >= m_width) return -1;
+    return first_set_in_span(&m_solid_columns[tile_x * m_column_words], m_height, from_y, to_y);
+}
+
+bool Map::sweep_box(glm::vec3 position, float width, float height, glm::vec3 displacement, float *time_of_impact, glm::vec3 *normal)
+{
+    // Work in tile units with y pointing down, so tile (x, y) covers [x, x + 1] x [y, y + 1]
+    float start_u = (position.x + (m_tile_size / 2)) / m_tile_size;
+    float start_v = (-position.y + (m_tile_size / 2)) / m_tile_size;
+    float delta_u = displacement.x / m_tile_size;
+    float delta_v = -displacement.y / m_tile_size;
+    
+    // Sweeping a box against tiles is the same as casting its centre against tiles grown by its half size
+    float extent_u = (width / 2 - SWEEP_SKIN) / m_tile_size;
+    float extent_v = (height / 2 - SWEEP_SKIN) / m_tile_size;
+    int reach_u = (int) ceilf(extent_u);
+    int reach_v = (int) ceilf(extent_v);
+    
+    float best_time = 2.0f;
+    int best_axis = -1;
+    
+    int cell_u = (int) floorf(start_u);
+    int cell_v = (int) floorf(start_v);
+    int step_u = delta_u > 0 ? 1 : -1;
+    int step_v = delta_v > 0 ? 1 : -1;
+    
+    float t_delta_u = delta_u != 0 ? fabsf(1.0f / delta_u) : INFINITY;
+    float t_delta_v = delta_v != 0 ? fabsf(1.0f / delta_v) : INFINITY;
+    float t_next_u = delta_u > 0 ? (cell_u + 1 - start_u) * t_delta_u : delta_u < 0 ? (start_u - cell_u) * t_delta_u : INFINITY;
+    float t_next_v = delta_v > 0 ? (cell_v + 1 - start_v) * t_delta_v : delta_v < 0 ? (start_v - cell_v) * t_delta_v : INFINITY;
+    float t_cell = 0.0f;
     
-    float tile_center_x = (tile_x  * m_tile_size);
-    float tile_center_y = -(tile_y * m_tile_size);
+    while (t_cell <= 1.0f && t_cell <= best_time)
+    {
+        for (int tile_v = cell_v - reach_v; tile_v <= cell_v + reach_v; tile_v++)
+        {
+            // Visit only the solid tiles of this row's span
+            for (int tile_u = first_solid_in_row(tile_v, cell_u - reach_u, cell_u + reach_u); tile_u >= 0;
+                 tile_u = tile_u < cell_u + reach_u ? first_solid_in_row(tile_v, tile_u + 1, cell_u + reach_u) : -1)
+            {
+                float entry_u = -INFINITY, exit_u = INFINITY;
+                float entry_v = -INFINITY, exit_v = INFINITY;
+                
+                if (delta_u != 0)
+                {
+                    float near_u = ((delta_u > 0 ? tile_u - extent_u : tile_u + 1 + extent_u) - start_u) / delta_u;
+                    float far_u  = ((delta_u > 0 ? tile_u + 1 + extent_u : tile_u - extent_u) - start_u) / delta_u;
+                    entry_u = near_u;
+                    exit_u = far_u;
+                }
+                else if (start_u <= tile_u - extent_u || start_u >= tile_u + 1 + extent_u) continue;
+                
+                if (delta_v != 0)
+                {
+                    float near_v = ((delta_v > 0 ? tile_v - extent_v : tile_v + 1 + extent_v) - start_v) / delta_v;
+                    float far_v  = ((delta_v > 0 ? tile_v + 1 + extent_v : tile_v - extent_v) - start_v) / delta_v;
+                    entry_v = near_v;
+                    exit_v = far_v;
+                }
+                else if (start_v <= tile_v - extent_v || start_v >= tile_v + 1 + extent_v) continue;
+                
+                float entry = fmaxf(entry_u, entry_v);
+                float exit = fminf(exit_u, exit_v);
+                
+                if (entry >= exit || entry < 0.0f || entry > 1.0f || entry >= best_time) continue;
+                
+                best_time = entry;
+                best_axis = entry_u > entry_v ? 0 : 1;
+            }
+        }
+        
+        if (t_next_u < t_next_v)
+        {
+            t_cell = t_next_u;
+            t_next_u += t_delta_u;
+            cell_u += step_u;
+        }
+        else
+        {
+            t_cell = t_next_v;
+            t_next_v += t_delta_v;
+            cell_v += step_v;
+        }
+    }
     
-    *penetration_x = (m_tile_size / 2) - fabs(position.x - tile_center_x);
-    *penetration_y = (m_tile_size / 2) - fabs(position.y - tile_center_y);
+    if (best_axis < 0) return false;
     
+    // Back off by the skin so the full-size box ends up touching the face rather than inside it
+    float axis_length = fabsf(best_axis == 0 ? displacement.x : displacement.y);
+    *time_of_impact = fmaxf(0.0f, best_time - SWEEP_SKIN / axis_length);
+    *normal = best_axis == 0 ? glm::vec3(displacement.x > 0 ? -1.0f : 1.0f, 0.0f, 0.0f)
+                             : glm::vec3(0.0f, displacement.y > 0 ? -1.0f : 1.0f, 0.0f);
     return true;
 }
@@ -4,6 +4,7 @@
 #include <GL/glew.h>
 #endif
 #define GL_GLEXT_PROTOTYPES 1
+#include <mutex>
 #include <vector>
 #include <math.h>
 #include <SDL.h>
@@ -12,43 +13,207 @@
 #include "glm/mat4x4.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "ShaderProgram.h"
+#include "Replay.hpp"
 
 class Map {
+public:
+    // MESH draws the streamed chunk meshes. TILE_TEXTURE uploads the level as a texture of
+    // tile ids and draws it as one quad whose fragment shader looks up each pixel's tile,
+    // so its cost follows the pixels covered rather than the size of the level.
+    enum RenderMode { MESH, TILE_TEXTURE };
+    
 private:
+    // Boxes are shrunk by this much per side while sweeping, so a box resting on
+    // the floor can slide along it without "hitting" the next floor tile
+    static constexpr float SWEEP_SKIN = 0.001f;
+    
+    // Meshes are built and dropped per CHUNK_SIZE x CHUNK_SIZE block of tiles. Chunks
+    // within STREAM_MARGIN chunks of the view are kept loaded ahead of the camera.
+    static const int CHUNK_SIZE = 32;
+    static const int STREAM_MARGIN = 1;
+    static const size_t DEFAULT_CHUNK_BUDGET = 4 * 1024 * 1024;
+    
+    // Interleaved x, y, u, v per vertex, six vertices per tile
+    static const int FLOATS_PER_VERTEX = 4;
+    static const int FLOATS_PER_QUAD = 6 * FLOATS_PER_VERTEX;
+    
+    struct Chunk
+    {
+        GLuint buffer = 0;
+        int vertex_count = 0;
+        int column_starts[CHUNK_SIZE + 1]; // Tiles are meshed column by column; first vertex of each
+        bool resident = false;
+        bool dirty = false;
+        unsigned long last_wanted = 0; // stream() call that last had this chunk in range
+    };
+    
+    struct TileEdit
+    {
+        int x, y;
+        unsigned int tile;
+    };
+    
     int m_width;
     int m_height;
     
-    unsigned int *m_level_data;
+    // The map's own copy, so edits never reach the array it was built from
+    std::vector<unsigned int> m_level_data;
     GLuint m_texture_id;
+    glm::vec4 m_texture_rect; // Where the tileset sits inside m_texture_id: u, v, width, height
     
     float m_tile_size;
     int m_tile_count_x;
     int m_tile_count_y;
     
-    std::vector<float> m_vertices;
-    std::vector<float> m_texture_coordinates;
+    int m_chunk_count_x;
+    int m_chunk_count_y;
+    std::vector<Chunk> m_chunks;
+    std::vector<int> m_resident_chunks;
+    std::vector<float> m_mesh_scratch;
+    size_t m_chunk_budget;
+    size_t m_resident_bytes;
+    unsigned long m_stream_count;
+    unsigned long m_chunk_loads;
+    unsigned long m_chunk_evictions;
+    
+    // set_tile() runs with the simulation and stream() with the renderer, possibly on
+    // different threads. Meshes are built from m_mesh_tiles, the renderer's own copy of
+    // the level, which only changes when stream() applies the edits handed over by
+    // publish_edits().
+    std::vector<unsigned int> m_mesh_tiles;
+    std::vector<TileEdit> m_tick_edits;
+    std::vector<TileEdit> m_queued_edits;
+    std::vector<TileEdit> m_applying_edits;
+    std::mutex m_edit_mutex;
+    unsigned long m_quads_patched;
+    unsigned long m_edit_remeshes;
+    // Every set_tile() that changed a tile, folded in order into one digest for the replay hash
+    unsigned long m_edit_count;
+    unsigned long long m_edit_hash;
+    
+    // TILE_TEXTURE keeps each tile id in the red (low byte) and green (high byte) of one
+    // texel, since GL 2.1 has no integer textures. Tiles run row after row, wrapped every
+    // INDEX_ROW_LENGTH texels so that long levels stay within the texture size limit.
+    static const int INDEX_ROW_LENGTH = 1024;
+    
+    RenderMode m_render_mode;
+    GLuint m_index_texture;
+    int m_index_width;
+    int m_index_height;
+    GLuint m_tilemap_program; // The program the uniform locations below belong to
+    GLint m_map_origin_uniform, m_index_layout_uniform, m_tile_count_uniform, m_tileset_rect_uniform, m_tile_index_uniform;
     
     float m_left_bound, m_right_bound, m_top_bound, m_bottom_bound;
     
+    // One bit per tile, set when the tile is solid. m_solid_rows is row-major with
+    // m_row_words 64-bit words per row; m_solid_columns is the same data column-major
+    // so column spans are bit scans too.
+    std::vector<unsigned long long> m_solid_rows;
+    std::vector<unsigned long long> m_solid_columns;
+    int m_row_words;
+    int m_column_words;
+    float m_inverse_tile_size;
+    
+    void build_bounds();
+    void build_collision();
+    void mesh_chunk(int chunk_index);
+    void load_chunk(int chunk_index);
+    void evict_chunk(int chunk_index);
+    void write_quad(float *target, int tile_x, int tile_y, unsigned int tile) const;
+    void apply_edits();
+    void upload_index();
+    void delete_index();
+    void render_tile_texture(ShaderProgram *program, float left, float right);
+    
 public:
-    Map(int width, int height, unsigned int *level_data, GLuint texture_id, float tile_size, int tile_count_x, int tile_count_y);
+    Map(int width, int height, const unsigned int *level_data, GLuint texture_id, float tile_size, int tile_count_x, int tile_count_y);
+    // Collision-only map for headless runs: no texture and no vertex generation
+    Map(int width, int height, const unsigned int *level_data, float tile_size);
+    ~Map();
     
     void build();
-    void render(ShaderProgram *program);
+    // Draws only the tile columns overlapping [left, right]; the rest count as culled. In
+    // TILE_TEXTURE mode `program` must be the tilemap shader, and one quad is drawn.
+    void render(ShaderProgram *program, float left, float right);
+    
+    // Switching to TILE_TEXTURE drops every chunk mesh; the index texture is uploaded on
+    // the next stream(). Switching back deletes it and chunks stream in as before.
+    void set_render_mode(RenderMode mode);
+    RenderMode const get_render_mode() const { return m_render_mode; }
+    
+    // Meshes every chunk within the margin of the view rectangle and then evicts the
+    // chunks wanted least recently until the resident meshes fit the budget. Chunks in
+    // range are never evicted, so a budget smaller than the view is exceeded, not obeyed.
+    void stream(float left, float right, float top, float bottom);
+    void set_chunk_budget(size_t bytes) { m_chunk_budget = bytes; }
+    // For a tileset packed into an atlas page; resident chunks are re-meshed on the next stream()
+    void set_texture(GLuint texture_id, glm::vec4 texture_rect);
+    
+    // Changes one tile: the level data and collision bits right away, the mesh on the
+    // stream() after the next publish_edits(). Returns false off the map.
+    bool set_tile(int tile_x, int tile_y, unsigned int tile);
+    unsigned int get_tile(int tile_x, int tile_y) const { return m_level_data[tile_y * m_width + tile_x]; }
+    // Hands every set_tile() since the last call to the renderer in one batch; call once
+    // per tick, or per batch of ticks. stream() then swaps the tile's quad in place when
+    // one tile replaces another, and re-meshes just its chunk when a tile appears or goes.
+    void publish_edits();
     bool is_solid(glm::vec3 position, float *penetration_x, float *penetration_y);
+    bool is_solid_tile(int tile_x, int tile_y) const
+    {
+        if ((unsigned int) tile_x >= (unsigned int) m_width || (unsigned int) tile_y >= (unsigned int) m_height) return false;
+        return (m_solid_rows[tile_y * m_row_words + (tile_x >> 6)] >> (tile_x & 63)) & 1;
+    }
+    
+    // First solid tile met walking from `from` to `to` (either direction, inclusive)
+    // along a row or column, or -1 if that span is empty. Spans may run off the map.
+    int first_solid_in_row(int tile_y, int from_x, int to_x) const;
+    int first_solid_in_column(int tile_x, int from_y, int to_y) const;
+    
+    // World position to tile index, matching is_solid; rows count up as y goes down
+    int tile_column(float x) const { return (int) floorf((x + (m_tile_size / 2)) * m_inverse_tile_size); }
+    int tile_row(float y) const { return (int) (-ceilf(y - (m_tile_size / 2)) * m_inverse_tile_size); }
+    float tile_center_x(int tile_x) const { return tile_x * m_tile_size; }
+    float tile_center_y(int tile_y) const { return -(tile_y * m_tile_size); }
+    
+    // Sweeps a width x height box centred at `position` along `displacement`, walking
+    // the tiles under the motion ray (DDA). On a hit, `time_of_impact` is the fraction
+    // of the displacement travelled before touching and `normal` is the face hit.
+    // Boxes already overlapping a tile at the start ignore it; is_solid handles those.
+    bool sweep_box(glm::vec3 position, float width, float height, glm::vec3 displacement, float *time_of_impact, glm::vec3 *normal);
+    // A sweep of a box with no size: the fraction of `displacement` travelled from `origin`
+    // before entering a solid tile, which lands in `tile_x`, `tile_y`. A tile holding the
+    // origin is ignored, as above.
+    bool raycast(glm::vec3 origin, glm::vec3 displacement, float *time_of_impact, int *tile_x, int *tile_y)
+    {
+        glm::vec3 normal;
+        if (!sweep_box(origin, 2.0f * SWEEP_SKIN, 2.0f * SWEEP_SKIN, displacement, time_of_impact, &normal)) return false;
+        
+        // The contact sits a skin short of the face; half a tile past it is inside the tile
+        glm::vec3 inside = origin + displacement * *time_of_impact - normal * (SWEEP_SKIN + m_tile_size / 2);
+        *tile_x = tile_column(inside.x);
+        *tile_y = tile_row(inside.y);
+        return true;
+    }
     
     int const get_width() const { return m_width;  }
     int const get_height() const { return m_height; }
     
-    unsigned int* const get_level_data() const { return m_level_data; }
+    const unsigned int* const get_level_data() const { return m_level_data.data(); }
     GLuint const get_texture_id() const { return m_texture_id; }
     
     float const get_tile_size() const { return m_tile_size;    }
     int const get_tile_count_x() const { return m_tile_count_x; }
     int const get_tile_count_y() const { return m_tile_count_y; }
     
-    std::vector<float> const get_vertices() const { return m_vertices; }
-    std::vector<float> const get_texture_coordinates() const { return m_texture_coordinates; }
+    int const get_resident_chunk_count() const { return (int) m_resident_chunks.size(); }
+    size_t const get_resident_chunk_bytes() const { return m_resident_bytes; }
+    unsigned long const get_chunk_loads() const { return m_chunk_loads; }
+    unsigned long const get_chunk_evictions() const { return m_chunk_evictions; }
+    // Untouched maps leave the hash alone, so replays from before tiles could change still match
+    unsigned long long const hash_state(unsigned long long hash) const;
+    unsigned long const get_quads_patched() const { return m_quads_patched; }
+    unsigned long const get_edit_remeshes() const { return m_edit_remeshes; }
+    size_t const get_index_texture_bytes() const { return (size_t) m_index_width * m_index_height * 4; }
     
     float const get_left_bound() const { return m_left_bound; }
     float const get_right_bound() const { return m_right_bound; }
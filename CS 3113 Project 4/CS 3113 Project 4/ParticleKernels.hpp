@@ -0,0 +1,16 @@
+#pragma once
+
+// Advances `count` particles held as separate arrays by `delta_time`: vertical velocity
+// by `gravity`, then position by velocity, then life down by each particle's decay rate
+// (life runs from 1 at spawn to 0). Bit i of `expired` (64 particles per word) is set
+// when particle i's life has run out; `expired` must hold (count + 63) / 64 words.
+// Uses AVX2, SSE2 or NEON when the build has them and a scalar loop otherwise.
+void integrate_particles(float *xs, float *ys, float *velocities_x, float *velocities_y, float *lives, const float *decays,
+                         int count, float gravity, float delta_time, unsigned long long *expired);
+
+// The plain loop the vector paths must agree with; kept callable for benchmarks
+void integrate_particles_scalar(float *xs, float *ys, float *velocities_x, float *velocities_y, float *lives, const float *decays,
+                                int count, float gravity, float delta_time, unsigned long long *expired);
+
+// Name of the instruction set integrate_particles was compiled for
+const char *integrate_particles_isa();
@@ -0,0 +1,141 @@
+#include "ParticleSystem.hpp"
+#include <math.h>
+#include "Collision.hpp"
+#include "ParticleKernels.hpp"
+
+float ParticleSystem::random_unit()
+{
+    m_seed = m_seed * 1664525u + 1013904223u;
+    return (float) (m_seed >> 8) / (float) (1 << 24);
+}
+
+int ParticleSystem::add_emitter(const ParticleEmitter &emitter, int capacity)
+{
+    Pool pool;
+    pool.emitter = emitter;
+    pool.capacity = capacity;
+    pool.xs.resize(capacity);
+    pool.ys.resize(capacity);
+    pool.velocities_x.resize(capacity);
+    pool.velocities_y.resize(capacity);
+    pool.lives.resize(capacity);
+    pool.decays.resize(capacity);
+    
+    m_pools.push_back(pool);
+    if ((int) m_expired.size() < (capacity + 63) / 64) m_expired.resize((capacity + 63) / 64);
+    if ((int) m_instances.size() < capacity * SpriteBatch::FLOATS_PER_INSTANCE) m_instances.resize(capacity * SpriteBatch::FLOATS_PER_INSTANCE);
+    return (int) m_pools.size() - 1;
+}
+
+void ParticleSystem::burst(int emitter, float x, float y, int count)
+{
+    m_tick_bursts.push_back({ emitter, x, y, count });
+}
+
+void ParticleSystem::publish_bursts()
+{
+    if (m_tick_bursts.empty()) return;
+    
+    std::lock_guard<std::mutex> lock(m_burst_mutex);
+    m_queued_bursts.insert(m_queued_bursts.end(), m_tick_bursts.begin(), m_tick_bursts.end());
+    m_tick_bursts.clear();
+}
+
+void ParticleSystem::spawn(const Burst &burst)
+{
+    Pool &pool = m_pools[burst.emitter];
+    const ParticleEmitter &emitter = pool.emitter;
+    
+    int count = burst.count;
+    if (count > pool.capacity - pool.count)
+    {
+        m_dropped += count - (pool.capacity - pool.count);
+        count = pool.capacity - pool.count;
+    }
+    
+    for (int i = pool.count; i < pool.count + count; i++)
+    {
+        float angle = emitter.angle + (random_unit() * 2.0f - 1.0f) * emitter.spread;
+        float speed = emitter.speed * (0.5f + 0.5f * random_unit());
+        
+        pool.xs[i] = burst.x;
+        pool.ys[i] = burst.y;
+        pool.velocities_x[i] = cosf(angle) * speed;
+        pool.velocities_y[i] = sinf(angle) * speed;
+        pool.lives[i] = 1.0f;
+        pool.decays[i] = 1.0f / (emitter.lifetime * (0.5f + 0.5f * random_unit()));
+    }
+    
+    pool.count += count;
+    m_spawned += count;
+}
+
+void ParticleSystem::update(float delta_time)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_burst_mutex);
+        m_applying_bursts.swap(m_queued_bursts);
+    }
+    for (const Burst &burst : m_applying_bursts) spawn(burst);
+    m_applying_bursts.clear();
+    
+    for (Pool &pool : m_pools)
+    {
+        if (pool.count == 0) continue;
+        
+        integrate_particles(pool.xs.data(), pool.ys.data(), pool.velocities_x.data(), pool.velocities_y.data(), pool.lives.data(),
+                            pool.decays.data(), pool.count, pool.emitter.gravity, delta_time, m_expired.data());
+        
+        // Highest index first, so the last particle moved into a gap is always a live one
+        for (int word = (pool.count - 1) >> 6; word >= 0; word--)
+        {
+            unsigned long long bits = m_expired[word];
+            while (bits != 0)
+            {
+                int dead = (word << 6) + highest_set_bit(bits);
+                bits &= ~(1ULL << (dead & 63));
+                
+                int last = --pool.count;
+                pool.xs[dead] = pool.xs[last];
+                pool.ys[dead] = pool.ys[last];
+                pool.velocities_x[dead] = pool.velocities_x[last];
+                pool.velocities_y[dead] = pool.velocities_y[last];
+                pool.lives[dead] = pool.lives[last];
+                pool.decays[dead] = pool.decays[last];
+                m_expired_count++;
+            }
+        }
+    }
+}
+
+void ParticleSystem::render(ShaderProgram *program)
+{
+    for (Pool &pool : m_pools)
+    {
+        if (pool.count == 0) continue;
+        
+        const ParticleEmitter &emitter = pool.emitter;
+        float *instance = m_instances.data();
+        for (int i = 0; i < pool.count; i++, instance += SpriteBatch::FLOATS_PER_INSTANCE)
+        {
+            float size = emitter.size * pool.lives[i];
+            instance[0] = pool.xs[i];
+            instance[1] = pool.ys[i];
+            instance[2] = size;
+            instance[3] = size;
+            instance[4] = emitter.u_coord;
+            instance[5] = emitter.v_coord;
+            instance[6] = emitter.width;
+            instance[7] = emitter.height;
+        }
+        
+        m_batch.draw_instances(program, emitter.texture_id, m_instances.data(), pool.count);
+    }
+}
+
+int const ParticleSystem::get_live_count() const
+{
+    int count = 0;
+    for (const Pool &pool : m_pools) count += pool.count;
+    return count;
+}
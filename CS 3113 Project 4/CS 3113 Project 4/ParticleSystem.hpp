@@ -0,0 +1,82 @@
+#pragma once
+#include <mutex>
+#include <vector>
+#include "SpriteBatch.hpp"
+
+// How an emitter's particles look and move. Bursts fire particles at `speed`, in
+// directions within `spread` radians either side of `angle` (0 is +x, pi/2 is up), and
+// each lives for between half and all of `lifetime` seconds, shrinking from `size` to
+// nothing as it goes.
+struct ParticleEmitter
+{
+    GLuint texture_id;
+    float u_coord, v_coord, width, height; // Where the particle image sits in the texture
+    float size;
+    float speed;
+    float angle, spread;
+    float lifetime;
+    float gravity;
+};
+
+// Visual-only particles, such as dust and debris, that never collide or feed back into
+// the game. Each emitter owns a fixed-capacity pool stored field by field, so update()
+// integrates every live particle in one vectorised pass (integrate_particles) and
+// render() draws each pool in one call. Expired particles are replaced by the pool's
+// last live one, so the live particles stay packed at the front.
+//
+// burst() runs with the simulation and update()/render() with the renderer, possibly on
+// different threads; bursts cross over in batches through publish_bursts(), the same
+// hand-over Map uses for tile edits.
+class ParticleSystem {
+private:
+    struct Pool
+    {
+        ParticleEmitter emitter;
+        int capacity;
+        int count = 0;
+        std::vector<float> xs, ys, velocities_x, velocities_y, lives, decays;
+    };
+    
+    struct Burst
+    {
+        int emitter;
+        float x, y;
+        int count;
+    };
+    
+    std::vector<Pool> m_pools;
+    std::vector<unsigned long long> m_expired;
+    std::vector<float> m_instances;
+    SpriteBatch m_batch;
+    unsigned int m_seed = 12345;
+    
+    std::vector<Burst> m_tick_bursts;
+    std::vector<Burst> m_queued_bursts;
+    std::vector<Burst> m_applying_bursts;
+    std::mutex m_burst_mutex;
+    
+    long m_spawned = 0;
+    long m_expired_count = 0;
+    long m_dropped = 0;
+    
+    float random_unit();
+    void spawn(const Burst &burst);
+    
+public:
+    // Returns the emitter's index for burst(). Pools are allocated here and never grow.
+    int add_emitter(const ParticleEmitter &emitter, int capacity);
+    
+    // Queues `count` particles from `emitter` at (x, y); they appear on the update()
+    // after the next publish_bursts(). Particles that don't fit in the pool are dropped.
+    void burst(int emitter, float x, float y, int count);
+    void publish_bursts();
+    
+    // Spawns the published bursts, advances every particle and removes the expired ones
+    void update(float delta_time);
+    void render(ShaderProgram *program);
+    
+    int const get_live_count() const;
+    long const get_spawned() const { return m_spawned; }
+    long const get_expired() const { return m_expired_count; }
+    long const get_dropped() const { return m_dropped; }
+};
@@ -0,0 +1,96 @@
+#include "PhysicsWorld.hpp"
+#include "Collision.hpp"
+#include <math.h>
+#include <stddef.h>
+
+PhysicsWorld PhysicsWorld::s_shared;
+
+int PhysicsWorld::allocate(Entity *entity)
+{
+    int body;
+    if (!m_free_bodies.empty())
+    {
+        body = m_free_bodies.back();
+        m_free_bodies.pop_back();
+    }
+    else
+    {
+        body = (int) position_x.size();
+        position_x.push_back(0.0f);     position_y.push_back(0.0f);     position_z.push_back(0.0f);
+        velocity_x.push_back(0.0f);     velocity_y.push_back(0.0f);     velocity_z.push_back(0.0f);
+        acceleration_x.push_back(0.0f); acceleration_y.push_back(0.0f); acceleration_z.push_back(0.0f);
+        width.push_back(0.0f);          height.push_back(0.0f);
+        origin_x.push_back(0.0f);       origin_y.push_back(0.0f);
+        owner.push_back(NULL);
+        simulated.push_back(0.0f);
+    }
+    
+    position_x[body] = position_y[body] = position_z[body] = 0.0f;
+    velocity_x[body] = velocity_y[body] = velocity_z[body] = 0.0f;
+    acceleration_x[body] = acceleration_y[body] = acceleration_z[body] = 0.0f;
+    width[body] = height[body] = 0.8f;
+    origin_x[body] = origin_y[body] = 0.0f;
+    owner[body] = entity;
+    simulated[body] = 0.0f;
+    
+    return body;
+}
+
+void PhysicsWorld::release(int body)
+{
+    simulated[body] = 0.0f;
+    owner[body] = NULL;
+    // A far-away box that no query can overlap
+    position_x[body] = position_y[body] = INFINITY;
+    m_free_bodies.push_back(body);
+}
+
+// The mask multiply keeps these loops branch-free so the compiler can vectorise them
+
+void PhysicsWorld::integrate_velocity(float delta_time, int begin, int end)
+{
+    float *vx = velocity_x.data(), *vy = velocity_y.data(), *vz = velocity_z.data();
+    const float *ax = acceleration_x.data(), *ay = acceleration_y.data(), *az = acceleration_z.data();
+    const float *mask = simulated.data();
+    
+    for (int i = begin; i < end; i++)
+    {
+        float step = mask[i] * delta_time;
+        vx[i] += ax[i] * step;
+        vy[i] += ay[i] * step;
+        vz[i] += az[i] * step;
+    }
+}
+
+void PhysicsWorld::integrate_y(float delta_time, int begin, int end)
+{
+    float *py = position_y.data();
+    float *oy = origin_y.data();
+    const float *vy = velocity_y.data();
+    const float *mask = simulated.data();
+    
+    for (int i = begin; i < end; i++)
+    {
+        oy[i] = py[i];
+        py[i] += vy[i] * mask[i] * delta_time;
+    }
+}
+
+void PhysicsWorld::integrate_x(float delta_time, int begin, int end)
+{
+    float *px = position_x.data();
+    float *ox = origin_x.data();
+    const float *vx = velocity_x.data();
+    const float *mask = simulated.data();
+    
+    for (int i = begin; i < end; i++)
+    {
+        ox[i] = px[i];
+        px[i] += vx[i] * mask[i] * delta_time;
+    }
+}
+
+void PhysicsWorld::overlap(float x, float y, float box_width, float box_height, unsigned long long *hits) const
+{
+    overlap_boxes(x, y, box_width, box_height, position_x.data(), position_y.data(), width.data(), height.data(), get_body_count(), hits);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+
+class Entity;
+
+// Struct-of-arrays store for the hot physics state of every Entity. An Entity only
+// keeps the index of its slot ("body"), so the integrators below stream through
+// tightly packed floats instead of dragging whole Entity objects through cache.
+class PhysicsWorld {
+private:
+    std::vector<int> m_free_bodies;
+    
+    static PhysicsWorld s_shared;
+    
+public:
+    std::vector<float> position_x, position_y, position_z;
+    std::vector<float> velocity_x, velocity_y, velocity_z;
+    std::vector<float> acceleration_x, acceleration_y, acceleration_z;
+    std::vector<float> width, height;
+    
+    // Where each body was before the last integrate_x/integrate_y pass moved it,
+    // so collision can sweep the whole step instead of probing only its end
+    std::vector<float> origin_x, origin_y;
+    
+    // The Entity that owns each body, for turning batch query hits back into entities
+    std::vector<Entity *> owner;
+    
+    // 1 while a body should be moved by the integrators this tick, 0 otherwise
+    std::vector<float> simulated;
+    
+    static PhysicsWorld &shared() { return s_shared; }
+    
+    int allocate(Entity *entity);
+    void release(int body);
+    
+    // Each pass covers bodies [begin, end) and leaves unsimulated bodies untouched
+    void integrate_velocity(float delta_time, int begin, int end);
+    void integrate_y(float delta_time, int begin, int end);
+    void integrate_x(float delta_time, int begin, int end);
+    
+    // Sets bit b of `hits` for every body b in the store overlapping the box; see overlap_boxes
+    void overlap(float x, float y, float box_width, float box_height, unsigned long long *hits) const;
+    
+    int const get_body_count() const { return (int) position_x.size(); }
+};
@@ -0,0 +1,207 @@
+#include "ProjectileSystem.hpp"
+#include <math.h>
+#include "Entity.hpp"
+#include "Map.hpp"
+#include "SpatialGrid.hpp"
+#include "Replay.hpp"
+
+// Slab test of the segment from (x, y) along (delta_x, delta_y) against a box; on a hit,
+// `time` is the fraction of the segment travelled before entering it (0 if it starts
+// inside). Strict, like Entity::check_collision, so grazing an edge is a miss.
+static bool segment_hits_box(float x, float y, float delta_x, float delta_y, float box_x, float box_y, float half_width, float half_height,
+                             float *time)
+{
+    float entry = 0.0f, exit = 1.0f;
+    
+    if (delta_x != 0.0f)
+    {
+        float near_x = (box_x - (delta_x > 0.0f ? half_width : -half_width) - x) / delta_x;
+        float far_x  = (box_x + (delta_x > 0.0f ? half_width : -half_width) - x) / delta_x;
+        entry = fmaxf(entry, near_x);
+        exit = fminf(exit, far_x);
+    }
+    else if (fabsf(x - box_x) >= half_width) return false;
+    
+    if (delta_y != 0.0f)
+    {
+        float near_y = (box_y - (delta_y > 0.0f ? half_height : -half_height) - y) / delta_y;
+        float far_y  = (box_y + (delta_y > 0.0f ? half_height : -half_height) - y) / delta_y;
+        entry = fmaxf(entry, near_y);
+        exit = fminf(exit, far_y);
+    }
+    else if (fabsf(y - box_y) >= half_height) return false;
+    
+    if (entry >= exit) return false;
+    *time = entry;
+    return true;
+}
+
+ProjectileSystem::ProjectileSystem(int capacity)
+{
+    m_capacity = capacity;
+    m_xs.resize(capacity, 0.0f);
+    m_ys.resize(capacity, 0.0f);
+    m_velocities_x.resize(capacity, 0.0f);
+    m_velocities_y.resize(capacity, 0.0f);
+    m_lifetimes.resize(capacity, 0.0f);
+    m_alive.resize(capacity, 0);
+    m_free.reserve(capacity);
+}
+
+int ProjectileSystem::spawn(float x, float y, float velocity_x, float velocity_y, float lifetime)
+{
+    // Reuse freed slots before touching new ones, so the sweep in update() stays short
+    int slot;
+    if (!m_free.empty())
+    {
+        slot = m_free.back();
+        m_free.pop_back();
+    }
+    else if (m_high_water < m_capacity) slot = m_high_water++;
+    else
+    {
+        m_dropped++;
+        return -1;
+    }
+    
+    m_xs[slot] = x;
+    m_ys[slot] = y;
+    m_velocities_x[slot] = velocity_x;
+    m_velocities_y[slot] = velocity_y;
+    m_lifetimes[slot] = lifetime;
+    m_alive[slot] = 1;
+    
+    m_live_count++;
+    m_spawned++;
+    return slot;
+}
+
+void ProjectileSystem::kill(int slot)
+{
+    // A dead slot keeps being swept, so it must not drift anywhere
+    m_velocities_x[slot] = 0.0f;
+    m_velocities_y[slot] = 0.0f;
+    m_alive[slot] = 0;
+    
+    m_free.push_back(slot);
+    m_live_count--;
+}
+
+void ProjectileSystem::update(float delta_time, Map *map, Entity *enemies, const SpatialGrid *grid)
+{
+    const float half_size = SIZE / 2.0f;
+    
+    for (int slot = 0; slot < m_high_water; slot++)
+    {
+        if (!m_alive[slot]) continue;
+        if (m_lifetimes[slot] <= 0.0f)
+        {
+            kill(slot);
+            m_expired++;
+            continue;
+        }
+        
+        float x = m_xs[slot], y = m_ys[slot];
+        float delta_x = m_velocities_x[slot] * delta_time;
+        float delta_y = m_velocities_y[slot] * delta_time;
+        
+        // The map stops a bullet's centre; enemies are hit by any part of it
+        float nearest = 2.0f;
+        float time;
+        int tile_x, tile_y;
+        bool map_hit = map->raycast(glm::vec3(x, y, 0.0f), glm::vec3(delta_x, delta_y, 0.0f), &time, &tile_x, &tile_y);
+        if (map_hit) nearest = time;
+        
+        // Candidates come back in index order, so the lower index wins a tie
+        int target = -1;
+        const std::vector<int> &candidates = grid->query(fminf(x, x + delta_x) - half_size, fminf(y, y + delta_y) - half_size,
+                                                         fmaxf(x, x + delta_x) + half_size, fmaxf(y, y + delta_y) + half_size);
+        for (int index : candidates)
+        {
+            Entity &enemy = enemies[index];
+            if (!enemy.get_is_active()) continue;
+            
+            glm::vec3 position = enemy.get_position();
+            if (segment_hits_box(x, y, delta_x, delta_y, position.x, position.y, enemy.get_width() / 2.0f + half_size,
+                                 enemy.get_height() / 2.0f + half_size, &time) && time < nearest)
+            {
+                nearest = time;
+                target = index;
+            }
+        }
+        
+        if (target >= 0)
+        {
+            enemies[target].deactivate();
+            enemies[target].set_dead(true);
+            m_enemy_hits++;
+            kill(slot);
+        }
+        else if (map_hit)
+        {
+            m_map_hits++;
+            kill(slot);
+            
+            if (m_breaks_tiles && tile_x > 0 && tile_x < map->get_width() - 1 && tile_y < map->get_height() - 1 &&
+                map->set_tile(tile_x, tile_y, 0)) m_tiles_broken++;
+        }
+    }
+    
+    // Every slot ever used moves, live or not, so the loop has no branches to vectorise around
+    float *xs = m_xs.data(), *ys = m_ys.data(), *lifetimes = m_lifetimes.data();
+    const float *velocities_x = m_velocities_x.data(), *velocities_y = m_velocities_y.data();
+    for (int slot = 0; slot < m_high_water; slot++)
+    {
+        xs[slot] += velocities_x[slot] * delta_time;
+        ys[slot] += velocities_y[slot] * delta_time;
+        lifetimes[slot] -= delta_time;
+    }
+}
+
+int ProjectileSystem::snapshot(std::vector<SpriteSnapshot> &sprites, float delta_time, float left, float right, float top, float bottom) const
+{
+    const float half_size = SIZE / 2.0f;
+    int culled = 0;
+    
+    SpriteSnapshot sprite;
+    sprite.texture_id = m_texture_id;
+    sprite.depth = 0.0f;
+    sprite.scale_x = SIZE;
+    sprite.scale_y = SIZE;
+    sprite.uv = m_texture_rect;
+    
+    for (int slot = 0; slot < m_high_water; slot++)
+    {
+        if (!m_alive[slot]) continue;
+        
+        float x = m_xs[slot], y = m_ys[slot];
+        if (x + half_size <= left || x - half_size >= right || y - half_size >= top || y + half_size <= bottom)
+        {
+            culled++;
+            continue;
+        }
+        
+        sprite.x = x;
+        sprite.y = y;
+        sprite.previous_x = x - m_velocities_x[slot] * delta_time;
+        sprite.previous_y = y - m_velocities_y[slot] * delta_time;
+        sprites.push_back(sprite);
+    }
+    return culled;
+}
+
+unsigned long long const ProjectileSystem::hash_state(unsigned long long hash) const
+{
+    for (int slot = 0; slot < m_high_water; slot++)
+    {
+        if (!m_alive[slot]) continue;
+        
+        hash = hash_bytes(hash, &slot, sizeof(slot));
+        hash = hash_bytes(hash, &m_xs[slot], sizeof(float));
+        hash = hash_bytes(hash, &m_ys[slot], sizeof(float));
+        hash = hash_bytes(hash, &m_velocities_x[slot], sizeof(float));
+        hash = hash_bytes(hash, &m_velocities_y[slot], sizeof(float));
+        hash = hash_bytes(hash, &m_lifetimes[slot], sizeof(float));
+    }
+    return hash;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include "RenderSnapshot.hpp"
+
+class Entity;
+class Map;
+class SpatialGrid;
+
+// Bullets, stored field by field in a fixed-capacity pool. Slots are handed out from a
+// free list and go back on it when their bullet dies, so nothing is allocated once the
+// pool exists, whatever the rate of fire.
+//
+// update() walks the live bullets once: each one's path for the tick is ray cast against
+// the map and tested against the enemies the grid has near it, and the nearest hit kills
+// it (and the enemy, if that is what it met, or the tile when tiles are breakable). Every
+// slot then moves in one branch-free sweep.
+class ProjectileSystem {
+public:
+    // Bullets are squares this wide, for both drawing and hits
+    static constexpr float SIZE = 0.2f;
+    
+private:
+    int m_capacity;
+    int m_high_water = 0; // Slots at or past this have never been used
+    
+    std::vector<float> m_xs, m_ys, m_velocities_x, m_velocities_y, m_lifetimes;
+    std::vector<unsigned char> m_alive;
+    std::vector<int> m_free;
+    int m_live_count = 0;
+    
+    long m_spawned = 0;
+    long m_dropped = 0;
+    long m_expired = 0;
+    long m_map_hits = 0;
+    long m_enemy_hits = 0;
+    long m_tiles_broken = 0;
+    
+    bool m_breaks_tiles = false;
+    
+    GLuint m_texture_id = 0;
+    glm::vec4 m_texture_rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+    
+    void kill(int slot);
+    
+public:
+    ProjectileSystem(int capacity);
+    
+    // Fires a bullet that flies for `lifetime` seconds unless it hits something first.
+    // Returns its slot, or -1 (counted as dropped) when every slot is taken.
+    int spawn(float x, float y, float velocity_x, float velocity_y, float lifetime);
+    
+    // `grid` must have been rebuilt from `enemies` since they last moved
+    void update(float delta_time, Map *map, Entity *enemies, const SpatialGrid *grid);
+    
+    // Appends a sprite for every live bullet within the view, interpolating from where it
+    // was one `delta_time` earlier; returns how many were left out
+    int snapshot(std::vector<SpriteSnapshot> &sprites, float delta_time, float left, float right, float top, float bottom) const;
+    void set_texture(GLuint texture_id, glm::vec4 texture_rect) { m_texture_id = texture_id; m_texture_rect = texture_rect; }
+    // Bullets clear the tile they hit, except along the map's sides and floor
+    void set_breaks_tiles(bool breaks_tiles) { m_breaks_tiles = breaks_tiles; }
+    
+    // Live bullets only, so a session that never fires hashes the same as before bullets existed
+    unsigned long long const hash_state(unsigned long long hash) const;
+    
+    int const get_capacity() const { return m_capacity; }
+    int const get_live_count() const { return m_live_count; }
+    long const get_spawned() const { return m_spawned; }
+    long const get_dropped() const { return m_dropped; }
+    long const get_expired() const { return m_expired; }
+    long const get_map_hits() const { return m_map_hits; }
+    long const get_enemy_hits() const { return m_enemy_hits; }
+    long const get_tiles_broken() const { return m_tiles_broken; }
+    long const get_killed() const { return m_expired + m_map_hits + m_enemy_hits; }
+};
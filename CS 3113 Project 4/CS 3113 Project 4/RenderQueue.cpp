@@ -0,0 +1,143 @@
+#include "RenderQueue.hpp"
+#include <algorithm>
+#include <cassert>
+#include <string.h>
+#include "Map.hpp"
+#include "ParticleSystem.hpp"
+#include "TextRenderer.hpp"
+
+RenderQueue::RenderQueue(int thread_count)
+{
+    m_lists.resize(thread_count);
+}
+
+unsigned long long RenderQueue::make_key(Layer layer, const ShaderProgram *program, GLuint texture_id, float depth)
+{
+    // Flip the float's bits so larger depths (nearer the viewer) sort later, negatives included
+    unsigned int depth_bits;
+    memcpy(&depth_bits, &depth, sizeof(depth_bits));
+    depth_bits = (depth_bits & 0x80000000u) ? ~depth_bits : depth_bits | 0x80000000u;
+    
+    unsigned long long shader = program != NULL ? program->programID : 0;
+    assert(shader < (1u << 12) && texture_id < (1u << 16));
+    return ((unsigned long long) layer << 60) | (shader << 48) | ((unsigned long long) texture_id << 32) | depth_bits;
+}
+
+void RenderQueue::begin()
+{
+    for (CommandList &list : m_lists)
+    {
+        list.entries.clear();
+        list.maps.clear();
+        list.sprites.clear();
+        list.particles.clear();
+        list.texts.clear();
+    }
+}
+
+void RenderQueue::push_map(int thread, Map *map, ShaderProgram *program, float left, float right)
+{
+    CommandList &list = m_lists[thread];
+    Entry entry = { make_key(LAYER_MAP, program, map->get_texture_id(), 0.0f), (unsigned short) thread, DRAW_MAP, (unsigned int) list.maps.size() };
+    list.entries.push_back(entry);
+    list.maps.push_back({ map, program, left, right });
+}
+
+void RenderQueue::push_sprite(int thread, ShaderProgram *program, GLuint texture_id, float depth, float x, float y, float scale_x, float scale_y,
+                              float u_coord, float v_coord, float width, float height)
+{
+    CommandList &list = m_lists[thread];
+    Entry entry = { make_key(LAYER_SPRITES, program, texture_id, depth), (unsigned short) thread, DRAW_SPRITE, (unsigned int) list.sprites.size() };
+    list.entries.push_back(entry);
+    list.sprites.push_back({ program, texture_id, { x, y, scale_x, scale_y, u_coord, v_coord, width, height } });
+}
+
+void RenderQueue::push_particles(int thread, ParticleSystem *particles, ShaderProgram *program)
+{
+    CommandList &list = m_lists[thread];
+    Entry entry = { make_key(LAYER_PARTICLES, program, 0, 0.0f), (unsigned short) thread, DRAW_PARTICLES, (unsigned int) list.particles.size() };
+    list.entries.push_back(entry);
+    list.particles.push_back({ particles, program });
+}
+
+void RenderQueue::push_text(int thread, TextRenderer *text, ShaderProgram *program, const std::string &string, float size, float spacing,
+                            const glm::mat4 &model_matrix)
+{
+    CommandList &list = m_lists[thread];
+    Entry entry = { make_key(LAYER_TEXT, program, 0, 0.0f), (unsigned short) thread, DRAW_TEXT, (unsigned int) list.texts.size() };
+    list.entries.push_back(entry);
+    list.texts.push_back({ text, program, string, size, spacing, model_matrix });
+}
+
+void RenderQueue::push_hud(int thread, TextRenderer *text, ShaderProgram *program, const glm::mat4 &model_matrix)
+{
+    CommandList &list = m_lists[thread];
+    Entry entry = { make_key(LAYER_HUD, program, 0, 0.0f), (unsigned short) thread, FLUSH_HUD, (unsigned int) list.texts.size() };
+    list.entries.push_back(entry);
+    list.texts.push_back({ text, program, std::string(), 0.0f, 0.0f, model_matrix });
+}
+
+void RenderQueue::sort()
+{
+    m_sorted.clear();
+    for (CommandList &list : m_lists) m_sorted.insert(m_sorted.end(), list.entries.begin(), list.entries.end());
+    
+    // A byte-wise radix sort measured no faster than this on --bench queue's 200k
+    // commands, and a frame's few dozen gain nothing from it either
+    std::stable_sort(m_sorted.begin(), m_sorted.end(), [](const Entry &a, const Entry &b) { return a.key < b.key; });
+}
+
+void RenderQueue::execute()
+{
+    ShaderProgram *batch_program = NULL;
+    
+    for (const Entry &entry : m_sorted)
+    {
+        CommandList &list = m_lists[entry.list];
+        
+        if (entry.type == DRAW_SPRITE)
+        {
+            const SpriteCommand &sprite = list.sprites[entry.index];
+            if (sprite.program != batch_program)
+            {
+                if (batch_program != NULL) m_batch.flush(batch_program);
+                m_batch.begin();
+                batch_program = sprite.program;
+            }
+            
+            const float *instance = sprite.instance;
+            m_batch.add(sprite.texture_id, instance[0], instance[1], instance[2], instance[3], instance[4], instance[5], instance[6], instance[7]);
+            continue;
+        }
+        
+        // Anything else draws directly, so the sprites before it must go out first
+        if (batch_program != NULL)
+        {
+            m_batch.flush(batch_program);
+            batch_program = NULL;
+        }
+        
+        if (entry.type == DRAW_MAP)
+        {
+            const MapCommand &command = list.maps[entry.index];
+            command.map->render(command.program, command.left, command.right);
+        }
+        else if (entry.type == DRAW_PARTICLES)
+        {
+            const ParticleCommand &command = list.particles[entry.index];
+            command.particles->render(command.program);
+        }
+        else if (entry.type == DRAW_TEXT)
+        {
+            const TextCommand &command = list.texts[entry.index];
+            command.text->draw(command.program, command.string, command.size, command.spacing, command.model_matrix);
+        }
+        else
+        {
+            const TextCommand &command = list.texts[entry.index];
+            command.text->flush_hud(command.program, command.model_matrix);
+        }
+    }
+    
+    if (batch_program != NULL) m_batch.flush(batch_program);
+}
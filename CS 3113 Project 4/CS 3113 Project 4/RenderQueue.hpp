@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "glm/mat4x4.hpp"
+#include "ShaderProgram.h"
+#include "SpriteBatch.hpp"
+
+class Map;
+class ParticleSystem;
+class TextRenderer;
+
+// Collects a frame's draws as compact commands under a 64-bit sort key, then sorts and
+// executes them in one pass. From the most significant bits down, the key holds the
+// layer (4 bits), shader (12), texture (16) and depth (32), so draws sharing state end
+// up adjacent and consecutive sprites collapse into SpriteBatch draws. GL hands out
+// program and texture names as small integers, far inside those widths; make_key
+// asserts they fit rather than let two of them share a key.
+//
+// Each submitting thread owns one command list, chosen by the `thread` argument, so
+// several threads can push at once without locking. execute() runs on the GL thread
+// after they are all done.
+class RenderQueue {
+public:
+    enum Layer { LAYER_MAP, LAYER_SPRITES, LAYER_PARTICLES, LAYER_TEXT, LAYER_HUD };
+    
+private:
+    enum CommandType { DRAW_MAP, DRAW_SPRITE, DRAW_PARTICLES, DRAW_TEXT, FLUSH_HUD };
+    
+    struct Entry
+    {
+        unsigned long long key;
+        unsigned short list;
+        unsigned short type;
+        unsigned int index;
+    };
+    
+    struct MapCommand { Map *map; ShaderProgram *program; float left, right; };
+    struct ParticleCommand { ParticleSystem *particles; ShaderProgram *program; };
+    struct SpriteCommand { ShaderProgram *program; GLuint texture_id; float instance[8]; };
+    struct TextCommand { TextRenderer *text; ShaderProgram *program; std::string string; float size, spacing; glm::mat4 model_matrix; };
+    
+    struct CommandList
+    {
+        std::vector<Entry> entries;
+        std::vector<MapCommand> maps;
+        std::vector<SpriteCommand> sprites;
+        std::vector<ParticleCommand> particles;
+        std::vector<TextCommand> texts;
+    };
+    
+    std::vector<CommandList> m_lists;
+    std::vector<Entry> m_sorted;
+    SpriteBatch m_batch;
+    
+    static unsigned long long make_key(Layer layer, const ShaderProgram *program, GLuint texture_id, float depth);
+    
+public:
+    RenderQueue(int thread_count);
+    
+    void begin();
+    
+    void push_map(int thread, Map *map, ShaderProgram *program, float left, float right);
+    // Sprites are unit quads placed and sized like SpriteBatch::add
+    void push_sprite(int thread, ShaderProgram *program, GLuint texture_id, float depth, float x, float y, float scale_x, float scale_y,
+                     float u_coord, float v_coord, float width, float height);
+    // Every live particle, one draw per emitter, over the sprites
+    void push_particles(int thread, ParticleSystem *particles, ShaderProgram *program);
+    void push_text(int thread, TextRenderer *text, ShaderProgram *program, const std::string &string, float size, float spacing,
+                   const glm::mat4 &model_matrix);
+    // Draws whatever was queued with TextRenderer::queue_hud
+    void push_hud(int thread, TextRenderer *text, ShaderProgram *program, const glm::mat4 &model_matrix);
+    
+    // Merges every thread's commands and orders them by key. Stable, so equal keys keep
+    // submission order within a thread, and lower thread indices come first.
+    void sort();
+    void execute();
+    
+    int const get_thread_count() const { return (int) m_lists.size(); }
+    int const get_command_count() const { return (int) m_sorted.size(); }
+};
@@ -0,0 +1,46 @@
+#pragma once
+#define GL_SILENCE_DEPRECATION
+#ifdef _WINDOWS
+#include <GL/glew.h>
+#endif
+#define GL_GLEXT_PROTOTYPES 1
+#include <chrono>
+#include <vector>
+#include <SDL_opengl.h>
+#include "glm/vec4.hpp"
+
+// One sprite as the simulation last left it: the texture and depth it sorts by, where
+// the unit quad goes (and went the tick before) and which atlas rectangle it shows
+struct SpriteSnapshot
+{
+    GLuint texture_id;
+    float depth;
+    float x, y, scale_x, scale_y;
+    float previous_x, previous_y;
+    glm::vec4 uv;
+};
+
+// Everything the renderer needs to draw a frame, copied out of the game state after a
+// batch of ticks so the render thread never reads entities the simulation is moving.
+// Slots are reused, so the sprite vector stops allocating once it reaches its peak.
+struct RenderSnapshot
+{
+    unsigned long tick = 0;
+    std::chrono::steady_clock::time_point published;
+    // Time the simulation had banked but not yet stepped when this was published
+    float accumulator = 0.0f;
+
+    float camera_x = 0.0f;
+    float previous_camera_x = 0.0f;
+    std::vector<SpriteSnapshot> sprites;
+    long sprites_culled = 0;
+
+    bool game_over = false;
+    bool mission = false;
+    
+    // Bullet counters for --stats, which can't read the simulation's pool directly
+    int bullets_live = 0;
+    long bullets_spawned = 0;
+    long bullets_killed = 0;
+    long bullets_dropped = 0;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+// Counters the renderer bumps as it submits work. main resets them every frame and
+// prints per-frame averages under --stats.
+struct RenderStats
+{
+    long draw_calls = 0;
+    long quads = 0;
+    long quads_culled = 0;
+    long bytes_uploaded = 0;
+    
+    // State changes and uniform uploads that reached the driver, and those GLState or
+    // ShaderProgram skipped because nothing would have changed
+    long gl_calls_issued = 0;
+    long gl_calls_elided = 0;
+};
+
+inline RenderStats g_render_stats;
@@ -0,0 +1,62 @@
+#include "Replay.hpp"
+#include <stdio.h>
+#include <string.h>
+
+const char REPLAY_MAGIC[4] = { 'R', 'P', 'L', 'Y' };
+const unsigned int REPLAY_VERSION = 1;
+
+void Replay::record(unsigned char input, unsigned long long hash)
+{
+    m_inputs.push_back(input);
+    m_hashes.push_back(hash);
+}
+
+bool Replay::save(const char *filepath) const
+{
+    FILE *file = fopen(filepath, "wb");
+    if (file == NULL) return false;
+    
+    unsigned int tick_count = (unsigned int) m_inputs.size();
+    unsigned int padding = (8 - (tick_count % 8)) % 8;
+    unsigned char zeros[8] = { 0 };
+    
+    bool ok = fwrite(REPLAY_MAGIC, 1, 4, file) == 4 &&
+              fwrite(&REPLAY_VERSION, sizeof(REPLAY_VERSION), 1, file) == 1 &&
+              fwrite(&tick_count, sizeof(tick_count), 1, file) == 1 &&
+              fwrite(zeros, 1, 4, file) == 4 &&
+              fwrite(m_inputs.data(), 1, tick_count, file) == tick_count &&
+              fwrite(zeros, 1, padding, file) == padding &&
+              fwrite(m_hashes.data(), sizeof(unsigned long long), tick_count, file) == tick_count;
+    
+    fclose(file);
+    return ok;
+}
+
+bool Replay::load(const char *filepath)
+{
+    FILE *file = fopen(filepath, "rb");
+    if (file == NULL) return false;
+    
+    char magic[4];
+    unsigned int version = 0;
+    unsigned int tick_count = 0;
+    unsigned char reserved[8];
+    
+    bool ok = fread(magic, 1, 4, file) == 4 && memcmp(magic, REPLAY_MAGIC, 4) == 0 &&
+              fread(&version, sizeof(version), 1, file) == 1 && version == REPLAY_VERSION &&
+              fread(&tick_count, sizeof(tick_count), 1, file) == 1 &&
+              fread(reserved, 1, 4, file) == 4;
+    
+    if (ok)
+    {
+        unsigned int padding = (8 - (tick_count % 8)) % 8;
+        m_inputs.resize(tick_count);
+        m_hashes.resize(tick_count);
+        ok = fread(m_inputs.data(), 1, tick_count, file) == tick_count &&
+             fread(reserved, 1, padding, file) == padding &&
+             fread(m_hashes.data(), sizeof(unsigned long long), tick_count, file) == tick_count;
+    }
+    
+    fclose(file);
+    return ok;
+}
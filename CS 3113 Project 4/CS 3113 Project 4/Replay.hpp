@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <stddef.h>
+
+// Rolling 64-bit FNV-1a, used to fingerprint the game state after every tick
+const unsigned long long HASH_SEED = 14695981039346656037ULL;
+
+inline unsigned long long hash_bytes(unsigned long long hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// A recorded session: one input bitmask and one state hash per FIXED_TIMESTEP tick.
+// On disk the header is followed by every input byte, then every hash, so the
+// file stays compact and the hashes stay 8-byte aligned.
+class Replay {
+private:
+    std::vector<unsigned char> m_inputs;
+    std::vector<unsigned long long> m_hashes;
+    
+public:
+    static const unsigned char INPUT_LEFT  = 1 << 0,
+                               INPUT_RIGHT = 1 << 1,
+                               INPUT_JUMP  = 1 << 2,
+                               INPUT_FIRE  = 1 << 3;
+    
+    void record(unsigned char input, unsigned long long hash);
+    bool save(const char *filepath) const;
+    bool load(const char *filepath);
+    
+    int const get_tick_count() const { return (int) m_inputs.size(); }
+    unsigned char const get_input(int tick) const { return m_inputs[tick]; }
+    unsigned long long const get_hash(int tick) const { return m_hashes[tick]; }
+};
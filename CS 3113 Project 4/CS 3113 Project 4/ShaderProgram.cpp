@@ -1,6 +1,9 @@
 #define GL_SILENCE_DEPRECATION
 
 #include "ShaderProgram.h"
+#include "RenderStats.hpp"
+#include "StartupTimeline.hpp"
+#include "AssetBundle.hpp"
 
 void ShaderProgram::Load(const char *vertexShaderFile, const char *fragmentShaderFile) {
     
@@ -10,24 +13,32 @@ void ShaderProgram::Load(const char *vertexShaderFile, const char *fragmentShade
     fragmentShader = LoadShaderFromFile(fragmentShaderFile, GL_FRAGMENT_SHADER);
     
     // Create the final shader program from our vertex and fragment shaders
+    StartupTimeline::TimePoint linkStart = std::chrono::steady_clock::now();
     programID = glCreateProgram();
     glAttachShader(programID, vertexShader);
     glAttachShader(programID, fragmentShader);
     glLinkProgram(programID);
     
+    // Querying the status waits for the link, so the timeline sees its full cost
     GLint linkSuccess;
     glGetProgramiv(programID, GL_LINK_STATUS, &linkSuccess);
     if(linkSuccess == GL_FALSE) {
 	printf("Error linking shader program!\n");
     }
+    g_startup_timeline.record("link", std::string(vertexShaderFile) + " + " + fragmentShaderFile, linkStart, std::chrono::steady_clock::now());
     
     modelMatrixUniform = glGetUniformLocation(programID, "modelMatrix");
     projectionMatrixUniform = glGetUniformLocation(programID, "projectionMatrix");
     viewMatrixUniform = glGetUniformLocation(programID, "viewMatrix");
 	colorUniform = glGetUniformLocation(programID, "color");
     
+    hasModelMatrix = hasProjectionMatrix = hasViewMatrix = hasColor = false;
+    uniforms.clear();
+    
     positionAttribute = glGetAttribLocation(programID, "position");
     texCoordAttribute = glGetAttribLocation(programID, "texCoord");
+    instanceRectAttribute = glGetAttribLocation(programID, "instanceRect");
+    instanceUVAttribute = glGetAttribLocation(programID, "instanceUV");
 	
 	SetColor(1.0f, 1.0f, 1.0f, 1.0f);
     
@@ -35,11 +46,22 @@ void ShaderProgram::Load(const char *vertexShaderFile, const char *fragmentShade
 
 void ShaderProgram::Cleanup() {
     glDeleteProgram(programID);
+    g_gl_state.invalidate();
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 }
 
 GLuint ShaderProgram::LoadShaderFromFile(const std::string &shaderFile, GLenum type) {
+    StartupTimeline::TimePoint start = std::chrono::steady_clock::now();
+    
+    // A cooked bundle holds the source already, so compile it straight from the mapping
+    const AssetBundle::Entry *entry = g_asset_bundle.find(shaderFile.c_str(), AssetBundle::SHADER);
+    if (entry != NULL) {
+        GLuint shaderID = LoadShaderFromMemory((const char *) g_asset_bundle.get_data(entry), (GLint) entry->size, type);
+        g_startup_timeline.record("compile", shaderFile, start, std::chrono::steady_clock::now());
+        return shaderID;
+    }
+    
     //Open a file stream with the file name
     std::ifstream infile(shaderFile);
     
@@ -52,19 +74,20 @@ GLuint ShaderProgram::LoadShaderFromFile(const std::string &shaderFile, GLenum t
     buffer << infile.rdbuf();
     
     // Load the shader from the contents of the file
-    return LoadShaderFromString(buffer.str(), type);
+    GLuint shaderID = LoadShaderFromString(buffer.str(), type);
+    g_startup_timeline.record("compile", shaderFile, start, std::chrono::steady_clock::now());
+    return shaderID;
 }
 
 GLuint ShaderProgram::LoadShaderFromString(const std::string &shaderContents, GLenum type) {
-    
+    return LoadShaderFromMemory(shaderContents.c_str(), (GLint) shaderContents.size(), type);
+}
+
+GLuint ShaderProgram::LoadShaderFromMemory(const char *shaderString, GLint shaderStringLength, GLenum type) {
     
     // Create a shader of specified type
     GLuint shaderID = glCreateShader(type);
     
-    // Get the pointer to the C string from the STL string
-    const char *shaderString = shaderContents.c_str();
-    GLint shaderStringLength = (GLint) shaderContents.size();
-    
     // Set the shader source to the string and compile shader
     glShaderSource(shaderID, 1, &shaderString, &shaderStringLength);
     glCompileShader(shaderID);
@@ -85,21 +108,90 @@ GLuint ShaderProgram::LoadShaderFromString(const std::string &shaderContents, GL
 }
 
 void ShaderProgram::SetColor(float r, float g, float b, float a) {
-	glUseProgram(programID);
+    g_gl_state.use_program(programID);
+    
+    glm::vec4 value(r, g, b, a);
+    if (hasColor && value == color) { g_render_stats.gl_calls_elided++; return; }
+    
 	glUniform4f(colorUniform, r, g, b, a);
+    color = value;
+    hasColor = true;
+    g_render_stats.gl_calls_issued++;
+}
+
+// Records `value` for `location` and returns true, unless it already holds that value
+bool ShaderProgram::UpdateUniformCache(GLint location, const glm::vec4 &value) {
+    for (CachedUniform &uniform : uniforms) {
+        if (uniform.location != location) continue;
+        if (uniform.value == value) { g_render_stats.gl_calls_elided++; return false; }
+        
+        uniform.value = value;
+        g_render_stats.gl_calls_issued++;
+        return true;
+    }
+    
+    uniforms.push_back({ location, value });
+    g_render_stats.gl_calls_issued++;
+    return true;
+}
+
+void ShaderProgram::SetUniform(GLint location, int components, const glm::vec4 &value) {
+    g_gl_state.use_program(programID);
+    
+    if (location < 0 || !UpdateUniformCache(location, value)) return;
+    
+    switch (components) {
+        case 1: glUniform1f(location, value.x); break;
+        case 2: glUniform2f(location, value.x, value.y); break;
+        case 3: glUniform3f(location, value.x, value.y, value.z); break;
+        default: glUniform4f(location, value.x, value.y, value.z, value.w); break;
+    }
+}
+
+void ShaderProgram::SetSampler(GLint location, GLint unit) {
+    g_gl_state.use_program(programID);
+    
+    if (location < 0 || !UpdateUniformCache(location, glm::vec4((float) unit))) return;
+    
+    glUniform1i(location, unit);
+}
+
+void ShaderProgram::BindInstanceData(const float *instances) {
+    GLsizei stride = 8 * sizeof(float);
+    
+    // The arrays themselves are enabled through GLState::set_attributes
+    glVertexAttribPointer(instanceRectAttribute, 4, GL_FLOAT, false, stride, instances);
+    glVertexAttribDivisorARB(instanceRectAttribute, 1);
+    glVertexAttribPointer(instanceUVAttribute, 4, GL_FLOAT, false, stride, instances + 4);
+    glVertexAttribDivisorARB(instanceUVAttribute, 1);
+}
+
+void ShaderProgram::UnbindInstanceData() {
+    // Divisors are global state, so leave them as the non-instanced draws expect
+    glVertexAttribDivisorARB(instanceRectAttribute, 0);
+    glVertexAttribDivisorARB(instanceUVAttribute, 0);
+}
+
+// Uploads `matrix` into `uniform` unless `cached` already holds it
+static void SetMatrixUniform(GLuint programID, GLuint uniform, const glm::mat4 &matrix, glm::mat4 &cached, bool &hasCached) {
+    g_gl_state.use_program(programID);
+    
+    if (hasCached && matrix == cached) { g_render_stats.gl_calls_elided++; return; }
+    
+    glUniformMatrix4fv(uniform, 1, GL_FALSE, &matrix[0][0]);
+    cached = matrix;
+    hasCached = true;
+    g_render_stats.gl_calls_issued++;
 }
 
 void ShaderProgram::SetViewMatrix(const glm::mat4 &matrix) {
-    glUseProgram(programID);
-    glUniformMatrix4fv(viewMatrixUniform, 1, GL_FALSE, &matrix[0][0]);
+    SetMatrixUniform(programID, viewMatrixUniform, matrix, viewMatrix, hasViewMatrix);
 }
 
 void ShaderProgram::SetModelMatrix(const glm::mat4 &matrix) {
-    glUseProgram(programID);
-    glUniformMatrix4fv(modelMatrixUniform, 1, GL_FALSE, &matrix[0][0]);
+    SetMatrixUniform(programID, modelMatrixUniform, matrix, modelMatrix, hasModelMatrix);
 }
 
 void ShaderProgram::SetProjectionMatrix(const glm::mat4 &matrix) {
-    glUseProgram(programID);
-    glUniformMatrix4fv(projectionMatrixUniform, 1, GL_FALSE, &matrix[0][0]);    
+    SetMatrixUniform(programID, projectionMatrixUniform, matrix, projectionMatrix, hasProjectionMatrix);
 }
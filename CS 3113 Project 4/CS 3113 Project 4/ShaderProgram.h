@@ -9,7 +9,9 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <vector>
 #include "glm/mat4x4.hpp"
+#include "GLState.hpp"
 
 class ShaderProgram {
     public:
@@ -22,8 +24,26 @@ class ShaderProgram {
         void SetViewMatrix(const glm::mat4 &matrix);
 	
 		void SetColor(float r, float g, float b, float a);
+    
+        // For uniforms only some shaders declare, cached by location the same way.
+        // `components` is the uniform's float count (1-4); SetSampler takes a texture unit.
+        void SetUniform(GLint location, int components, const glm::vec4 &value);
+        void SetSampler(GLint location, GLint unit);
+	
+        // Points the per-instance attributes at `instances`, eight floats per instance:
+        // centre x, y, scale x, y, then the atlas rectangle's u, v, width, height
+        void BindInstanceData(const float *instances);
+        void UnbindInstanceData();
+        bool HasInstanceAttributes() const { return instanceRectAttribute >= 0 && instanceUVAttribute >= 0; }
+    
+        // Attribute masks for GLState::set_attributes. An attribute the shader doesn't use
+        // has location -1 and contributes no bit.
+        static unsigned int AttributeBit(GLint location) { return location >= 0 && location < (GLint) GLState::MAX_ATTRIBUTES ? 1u << location : 0u; }
+        unsigned int VertexAttributes() const { return AttributeBit(positionAttribute) | AttributeBit(texCoordAttribute); }
+        unsigned int InstanceAttributes() const { return AttributeBit(instanceRectAttribute) | AttributeBit(instanceUVAttribute); }
 	
         GLuint LoadShaderFromString(const std::string &shaderContents, GLenum type);
+        GLuint LoadShaderFromMemory(const char *shaderString, GLint shaderStringLength, GLenum type);
         GLuint LoadShaderFromFile(const std::string &shaderFile, GLenum type);
     
         GLuint programID;
@@ -33,9 +53,22 @@ class ShaderProgram {
         GLuint viewMatrixUniform;
 		GLuint colorUniform;
 	
-        GLuint positionAttribute;
-        GLuint texCoordAttribute;
+        GLint positionAttribute = -1;
+        GLint texCoordAttribute = -1;
+    
+        // -1 unless the vertex shader is the instanced variant
+        GLint instanceRectAttribute = -1;
+        GLint instanceUVAttribute = -1;
     
         GLuint vertexShader;
         GLuint fragmentShader;
+    
+        // Last values uploaded, so setting a uniform to what it already holds is skipped
+        glm::mat4 modelMatrix, projectionMatrix, viewMatrix;
+        glm::vec4 color;
+        bool hasModelMatrix = false, hasProjectionMatrix = false, hasViewMatrix = false, hasColor = false;
+    
+        struct CachedUniform { GLint location; glm::vec4 value; };
+        std::vector<CachedUniform> uniforms;
+        bool UpdateUniformCache(GLint location, const glm::vec4 &value);
 };
@@ -0,0 +1,79 @@
+#include "SpatialGrid.hpp"
+#include <algorithm>
+#include <math.h>
+#include "Entity.hpp"
+
+SpatialGrid::SpatialGrid(float cell_size)
+{
+    m_cell_size = cell_size;
+    m_bucket_mask = 0;
+    m_bucket_start.assign(2, 0);
+}
+
+unsigned int const SpatialGrid::bucket_of(int cell_x, int cell_y) const
+{
+    return (((unsigned int) cell_x * 73856093u) ^ ((unsigned int) cell_y * 19349663u)) & m_bucket_mask;
+}
+
+void SpatialGrid::rebuild(Entity *entities, int entity_count)
+{
+    // Keep about two buckets per entity so chains stay short
+    unsigned int bucket_count = 1;
+    while (bucket_count < (unsigned int) entity_count * 2) bucket_count <<= 1;
+    m_bucket_mask = bucket_count - 1;
+    
+    m_bucket_start.assign(bucket_count + 1, 0);
+    m_entity_bucket.resize(entity_count);
+    m_entries.resize(entity_count);
+    m_max_half_width = 0.0f;
+    m_max_half_height = 0.0f;
+    
+    for (int i = 0; i < entity_count; i++)
+    {
+        glm::vec3 position = entities[i].get_position();
+        int cell_x = (int) floorf(position.x / m_cell_size);
+        int cell_y = (int) floorf(position.y / m_cell_size);
+        
+        unsigned int bucket = bucket_of(cell_x, cell_y);
+        m_entity_bucket[i] = bucket;
+        m_bucket_start[bucket + 1]++;
+        
+        m_max_half_width = std::max(m_max_half_width, entities[i].get_width() / 2.0f);
+        m_max_half_height = std::max(m_max_half_height, entities[i].get_height() / 2.0f);
+    }
+    
+    for (unsigned int b = 0; b < bucket_count; b++) m_bucket_start[b + 1] += m_bucket_start[b];
+    
+    // Fill each bucket's slice in index order, so queries come back sorted per bucket
+    m_cursor.assign(m_bucket_start.begin(), m_bucket_start.end() - 1);
+    for (int i = 0; i < entity_count; i++) m_entries[m_cursor[m_entity_bucket[i]]++] = i;
+}
+
+const std::vector<int> &SpatialGrid::query(float min_x, float min_y, float max_x, float max_y) const
+{
+    m_results.clear();
+    m_visited.clear();
+    if (m_entries.empty()) return m_results;
+    
+    int first_x = (int) floorf((min_x - m_max_half_width)  / m_cell_size);
+    int last_x  = (int) floorf((max_x + m_max_half_width)  / m_cell_size);
+    int first_y = (int) floorf((min_y - m_max_half_height) / m_cell_size);
+    int last_y  = (int) floorf((max_y + m_max_half_height) / m_cell_size);
+    
+    for (int cell_y = first_y; cell_y <= last_y; cell_y++)
+    {
+        for (int cell_x = first_x; cell_x <= last_x; cell_x++)
+        {
+            // Two cells of one query can hash to the same bucket; read it only once
+            unsigned int bucket = bucket_of(cell_x, cell_y);
+            if (std::find(m_visited.begin(), m_visited.end(), bucket) != m_visited.end()) continue;
+            m_visited.push_back(bucket);
+            
+            m_results.insert(m_results.end(), m_entries.begin() + m_bucket_start[bucket], m_entries.begin() + m_bucket_start[bucket + 1]);
+        }
+    }
+    
+    // Callers resolve contacts in the same order as a linear scan would
+    std::sort(m_results.begin(), m_results.end());
+    return m_results;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+
+class Entity;
+
+// Uniform grid broadphase, hashed so it covers an unbounded world. Each entity is
+// filed under the cell holding its centre; queries widen their box by the largest
+// half-extent seen at rebuild, so an entity overlapping a neighbouring cell is
+// still found. Rebuilt from scratch every tick with a counting sort (O(n)).
+class SpatialGrid {
+private:
+    float m_cell_size;
+    unsigned int m_bucket_mask;
+    
+    std::vector<int> m_bucket_start;
+    std::vector<int> m_entries;
+    std::vector<unsigned int> m_entity_bucket;
+    std::vector<int> m_cursor;
+    
+    float m_max_half_width = 0.0f;
+    float m_max_half_height = 0.0f;
+    
+    mutable std::vector<int> m_results;
+    mutable std::vector<unsigned int> m_visited;
+    
+    unsigned int const bucket_of(int cell_x, int cell_y) const;
+    
+public:
+    SpatialGrid(float cell_size);
+    
+    void rebuild(Entity *entities, int entity_count);
+    
+    // Indices of every entity whose cell lies near the box, in ascending order.
+    // The returned vector is reused by the next query.
+    const std::vector<int> &query(float min_x, float min_y, float max_x, float max_y) const;
+    
+    float const get_cell_size() const { return m_cell_size; }
+    int const get_bucket_count() const { return (int) m_bucket_mask + 1; }
+};
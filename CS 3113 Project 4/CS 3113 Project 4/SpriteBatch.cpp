@@ -0,0 +1,153 @@
+#include "SpriteBatch.hpp"
+#include <algorithm>
+#include <math.h>
+#include "RenderStats.hpp"
+
+// The unit quad, in the same corner order and UV mapping as Entity::draw_sprite_from_texture_atlas
+static const float QUAD_CORNERS[]    = { -0.5, -0.5, 0.5, -0.5, 0.5, 0.5, -0.5, -0.5, 0.5, 0.5, -0.5, 0.5 };
+static const float QUAD_TEX_COORDS[] = {  0.0,  1.0, 1.0,  1.0, 1.0, 0.0,  0.0,  1.0, 1.0, 0.0,  0.0, 0.0 };
+
+void SpriteBatch::begin()
+{
+    m_sprites.clear();
+    m_group_textures.clear();
+}
+
+void SpriteBatch::add(GLuint texture_id, float x, float y, float scale_x, float scale_y, float u_coord, float v_coord, float width, float height)
+{
+    // Textures seen so far this frame are few, so a linear search is enough
+    int group = (int) (std::find(m_group_textures.begin(), m_group_textures.end(), texture_id) - m_group_textures.begin());
+    if (group == (int) m_group_textures.size()) m_group_textures.push_back(texture_id);
+    
+    Sprite sprite = { texture_id, group, { x, y, scale_x, scale_y, u_coord, v_coord, width, height } };
+    m_sprites.push_back(sprite);
+}
+
+void SpriteBatch::flush(ShaderProgram *program)
+{
+    if (m_sprites.empty()) return;
+    
+    std::stable_sort(m_sprites.begin(), m_sprites.end(), [](const Sprite &a, const Sprite &b) { return a.group < b.group; });
+    
+    program->SetModelMatrix(glm::mat4(1.0f));
+    
+    if (program->HasInstanceAttributes()) draw_instanced(program);
+    else draw_expanded(program);
+    
+    m_sprites.clear();
+    m_group_textures.clear();
+}
+
+void SpriteBatch::draw_instanced(ShaderProgram *program)
+{
+    m_instances.resize(m_sprites.size() * FLOATS_PER_INSTANCE);
+    for (size_t i = 0; i < m_sprites.size(); i++)
+    {
+        std::copy(m_sprites[i].instance, m_sprites[i].instance + FLOATS_PER_INSTANCE, &m_instances[i * FLOATS_PER_INSTANCE]);
+    }
+    
+    g_gl_state.bind_array_buffer(0);
+    g_gl_state.set_attributes(program->VertexAttributes() | program->InstanceAttributes());
+    glVertexAttribPointer(program->positionAttribute, 2, GL_FLOAT, false, 0, QUAD_CORNERS);
+    glVertexAttribPointer(program->texCoordAttribute, 2, GL_FLOAT, false, 0, QUAD_TEX_COORDS);
+    
+    size_t first = 0;
+    while (first < m_sprites.size())
+    {
+        size_t last = first;
+        while (last < m_sprites.size() && m_sprites[last].group == m_sprites[first].group) last++;
+        
+        program->BindInstanceData(&m_instances[first * FLOATS_PER_INSTANCE]);
+        g_gl_state.bind_texture(m_sprites[first].texture_id);
+        glDrawArraysInstancedARB(GL_TRIANGLES, 0, 6, (GLsizei) (last - first));
+        
+        g_render_stats.draw_calls++;
+        g_render_stats.quads += last - first;
+        first = last;
+    }
+    
+    program->UnbindInstanceData();
+}
+
+void SpriteBatch::draw_expanded(ShaderProgram *program)
+{
+    m_vertices.resize(m_sprites.size() * 6 * FLOATS_PER_VERTEX);
+    float *vertex = m_vertices.data();
+    for (const Sprite &sprite : m_sprites)
+    {
+        const float *instance = sprite.instance;
+        for (int corner = 0; corner < 6; corner++, vertex += FLOATS_PER_VERTEX)
+        {
+            vertex[0] = instance[0] + QUAD_CORNERS[corner * 2] * instance[2];
+            vertex[1] = instance[1] + QUAD_CORNERS[corner * 2 + 1] * instance[3];
+            vertex[2] = instance[4] + QUAD_TEX_COORDS[corner * 2] * instance[6];
+            vertex[3] = instance[5] + QUAD_TEX_COORDS[corner * 2 + 1] * instance[7];
+        }
+    }
+    
+    g_gl_state.bind_array_buffer(0);
+    g_gl_state.set_attributes(program->VertexAttributes());
+    
+    GLsizei stride = FLOATS_PER_VERTEX * sizeof(float);
+    glVertexAttribPointer(program->positionAttribute, 2, GL_FLOAT, false, stride, m_vertices.data());
+    glVertexAttribPointer(program->texCoordAttribute, 2, GL_FLOAT, false, stride, m_vertices.data() + 2);
+    
+    size_t first = 0;
+    while (first < m_sprites.size())
+    {
+        size_t last = first;
+        while (last < m_sprites.size() && m_sprites[last].group == m_sprites[first].group) last++;
+        
+        g_gl_state.bind_texture(m_sprites[first].texture_id);
+        glDrawArrays(GL_TRIANGLES, (GLint) (first * 6), (GLsizei) ((last - first) * 6));
+        
+        g_render_stats.draw_calls++;
+        g_render_stats.quads += last - first;
+        first = last;
+    }
+}
+
+void SpriteBatch::draw_instances(ShaderProgram *program, GLuint texture_id, const float *instances, int count)
+{
+    if (count == 0) return;
+    
+    program->SetModelMatrix(glm::mat4(1.0f));
+    g_gl_state.bind_array_buffer(0);
+    g_gl_state.bind_texture(texture_id);
+    
+    if (program->HasInstanceAttributes())
+    {
+        g_gl_state.set_attributes(program->VertexAttributes() | program->InstanceAttributes());
+        glVertexAttribPointer(program->positionAttribute, 2, GL_FLOAT, false, 0, QUAD_CORNERS);
+        glVertexAttribPointer(program->texCoordAttribute, 2, GL_FLOAT, false, 0, QUAD_TEX_COORDS);
+        
+        program->BindInstanceData(instances);
+        glDrawArraysInstancedARB(GL_TRIANGLES, 0, 6, count);
+        program->UnbindInstanceData();
+    }
+    else
+    {
+        m_vertices.resize((size_t) count * 6 * FLOATS_PER_VERTEX);
+        float *vertex = m_vertices.data();
+        for (int i = 0; i < count; i++)
+        {
+            const float *instance = instances + i * FLOATS_PER_INSTANCE;
+            for (int corner = 0; corner < 6; corner++, vertex += FLOATS_PER_VERTEX)
+            {
+                vertex[0] = instance[0] + QUAD_CORNERS[corner * 2] * instance[2];
+                vertex[1] = instance[1] + QUAD_CORNERS[corner * 2 + 1] * instance[3];
+                vertex[2] = instance[4] + QUAD_TEX_COORDS[corner * 2] * instance[6];
+                vertex[3] = instance[5] + QUAD_TEX_COORDS[corner * 2 + 1] * instance[7];
+            }
+        }
+        
+        g_gl_state.set_attributes(program->VertexAttributes());
+        GLsizei stride = FLOATS_PER_VERTEX * sizeof(float);
+        glVertexAttribPointer(program->positionAttribute, 2, GL_FLOAT, false, stride, m_vertices.data());
+        glVertexAttribPointer(program->texCoordAttribute, 2, GL_FLOAT, false, stride, m_vertices.data() + 2);
+        glDrawArrays(GL_TRIANGLES, 0, count * 6);
+    }
+    
+    g_render_stats.draw_calls++;
+    g_render_stats.quads += count;
+}
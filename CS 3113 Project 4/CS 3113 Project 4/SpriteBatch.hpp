@@ -0,0 +1,52 @@
+#pragma once
+#define GL_SILENCE_DEPRECATION
+#ifdef _WINDOWS
+#include <GL/glew.h>
+#endif
+#define GL_GLEXT_PROTOTYPES 1
+#include <vector>
+#include <SDL_opengl.h>
+#include "glm/mat4x4.hpp"
+#include "ShaderProgram.h"
+
+// Collects a frame's sprites and draws them with one draw call per texture. With a
+// program built from the instanced vertex shader each group is a single
+// glDrawArraysInstancedARB over per-sprite position, scale and UV rectangle; otherwise
+// the unit quads are expanded on the CPU and drawn with glDrawArrays. Sprites keep their
+// submission order within a texture; across textures, groups are drawn in order of
+// first use.
+class SpriteBatch {
+public:
+    static const int FLOATS_PER_INSTANCE = 8; // x, y, scale x, scale y, u, v, width, height
+    
+private:
+    static const int FLOATS_PER_VERTEX = 4;   // x, y, u, v
+    
+    struct Sprite
+    {
+        GLuint texture_id;
+        int group;
+        float instance[FLOATS_PER_INSTANCE];
+    };
+    
+    std::vector<Sprite> m_sprites;
+    std::vector<GLuint> m_group_textures;
+    std::vector<float> m_instances;
+    std::vector<float> m_vertices;
+    
+    void draw_instanced(ShaderProgram *program);
+    void draw_expanded(ShaderProgram *program);
+    
+public:
+    void begin();
+    // (u_coord, v_coord) is the top-left of the sprite's rectangle in the texture
+    void add(GLuint texture_id, float x, float y, float scale_x, float scale_y, float u_coord, float v_coord, float width, float height);
+    void flush(ShaderProgram *program);
+    
+    // Draws `count` sprites of one texture, already laid out FLOATS_PER_INSTANCE floats
+    // apiece, in one draw call. For callers that build thousands a frame and would
+    // only pay for add() and the sort in flush().
+    void draw_instances(ShaderProgram *program, GLuint texture_id, const float *instances, int count);
+    
+    int const get_sprite_count() const { return (int) m_sprites.size(); }
+};
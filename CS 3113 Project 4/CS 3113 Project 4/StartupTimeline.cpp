@@ -0,0 +1,65 @@
+#include "StartupTimeline.hpp"
+#include <algorithm>
+#include <stdio.h>
+
+void StartupTimeline::record(const std::string &category, const std::string &name, TimePoint start, TimePoint end)
+{
+    Event event;
+    event.category = category;
+    event.name = name;
+    event.start_ms = std::chrono::duration<double, std::milli>(start - m_origin).count();
+    event.end_ms = std::chrono::duration<double, std::milli>(end - m_origin).count();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::thread::id id = std::this_thread::get_id();
+    std::vector<std::thread::id>::iterator thread = std::find(m_threads.begin(), m_threads.end(), id);
+    event.thread = (int) (thread - m_threads.begin());
+    if (thread == m_threads.end()) m_threads.push_back(id);
+
+    m_events.push_back(event);
+}
+
+double StartupTimeline::total_ms(const std::string &category) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    double total = 0.0;
+    for (const Event &event : m_events)
+    {
+        if (event.category == category) total += event.end_ms - event.start_ms;
+    }
+    return total;
+}
+
+double StartupTimeline::elapsed_ms() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_origin).count();
+}
+
+bool StartupTimeline::write_json(const char *filepath) const
+{
+    FILE *file = fopen(filepath, "w");
+    if (file == NULL) return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Names are asset and shader paths, so quotes and backslashes are all that need escaping
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (size_t i = 0; i < m_events.size(); i++)
+    {
+        const Event &event = m_events[i];
+        std::string name;
+        for (char c : event.name)
+        {
+            if (c == '"' || c == '\\') name += '\\';
+            name += c;
+        }
+        fprintf(file, "  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.1f, \"dur\": %.1f, \"pid\": 0, \"tid\": %d}%s\n",
+                name.c_str(), event.category.c_str(), event.start_ms * 1e3, (event.end_ms - event.start_ms) * 1e3, event.thread,
+                i + 1 < m_events.size() ? "," : "");
+    }
+    fprintf(file, "]}\n");
+
+    return fclose(file) == 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Records how long each startup step took and on which thread, so time to first frame
+// can be tracked from build to build. Safe to record from any thread.
+class StartupTimeline {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+private:
+    struct Event
+    {
+        std::string category, name;
+        double start_ms, end_ms;
+        int thread;
+    };
+
+    TimePoint m_origin = std::chrono::steady_clock::now();
+    mutable std::mutex m_mutex;
+    std::vector<Event> m_events;
+    // Threads get small indices in the order they first record, so the main thread is 0
+    std::vector<std::thread::id> m_threads;
+
+public:
+    void record(const std::string &category, const std::string &name, TimePoint start, TimePoint end);
+
+    // Total time in one category, summed over threads
+    double total_ms(const std::string &category) const;
+    // Milliseconds since the program started
+    double elapsed_ms() const;
+
+    // Writes Chrome trace-event JSON, which chrome://tracing and Perfetto open directly
+    bool write_json(const char *filepath) const;
+};
+
+inline StartupTimeline g_startup_timeline;
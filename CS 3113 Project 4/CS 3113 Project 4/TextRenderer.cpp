@@ -0,0 +1,112 @@
+#include "TextRenderer.hpp"
+#include "RenderStats.hpp"
+
+TextRenderer::TextRenderer(const AtlasRegion &font, int fontbank_size)
+{
+    m_font = font;
+    m_fontbank_size = fontbank_size;
+}
+
+TextRenderer::~TextRenderer()
+{
+    for (auto &entry : m_runs) g_gl_state.delete_buffer(entry.second.buffer);
+}
+
+void TextRenderer::append_glyphs(std::vector<float> &vertices, const std::string &text, float size, float spacing, glm::vec3 position)
+{
+    // Scale the size of the fontbank in the UV-plane, within the font's atlas region
+    float width = m_font.rect.z / m_fontbank_size;
+    float height = m_font.rect.w / m_fontbank_size;
+    
+    for (int i = 0; i < (int) text.size(); i++) {
+        // Each glyph's index in the spritesheet is its ascii value; its offset is its place in the run
+        int spritesheet_index = (unsigned char) text[i];
+        float offset = position.x + (size + spacing) * i;
+        
+        float u_coordinate = m_font.rect.x + (float) (spritesheet_index % m_fontbank_size) * width;
+        float v_coordinate = m_font.rect.y + (float) (spritesheet_index / m_fontbank_size) * height;
+        
+        float left   = offset + (-0.5f * size), right  = offset + (0.5f * size);
+        float top    = position.y + (0.5f * size), bottom = position.y + (-0.5f * size);
+        
+        vertices.insert(vertices.end(), {
+            left,  top,    u_coordinate,         v_coordinate,
+            left,  bottom, u_coordinate,         v_coordinate + height,
+            right, top,    u_coordinate + width, v_coordinate,
+            right, bottom, u_coordinate + width, v_coordinate + height,
+            right, top,    u_coordinate + width, v_coordinate,
+            left,  bottom, u_coordinate,         v_coordinate + height,
+        });
+    }
+}
+
+void TextRenderer::draw_vertices(ShaderProgram *program, const glm::mat4 &model_matrix, const float *vertices, int vertex_count)
+{
+    program->SetModelMatrix(model_matrix);
+    
+    g_gl_state.set_attributes(program->VertexAttributes());
+    
+    GLsizei stride = 4 * sizeof(float);
+    glVertexAttribPointer(program->positionAttribute, 2, GL_FLOAT, false, stride, vertices);
+    glVertexAttribPointer(program->texCoordAttribute, 2, GL_FLOAT, false, stride, vertices + 2);
+    
+    g_gl_state.bind_texture(m_font.texture_id);
+    glDrawArrays(GL_TRIANGLES, 0, vertex_count);
+    
+    g_render_stats.draw_calls++;
+    g_render_stats.quads += vertex_count / 6;
+}
+
+void TextRenderer::draw(ShaderProgram *program, const std::string &text, float size, float spacing, const glm::mat4 &model_matrix)
+{
+    if (text.empty()) return;
+    
+    m_lookup.text.assign(text);
+    m_lookup.size = size;
+    m_lookup.spacing = spacing;
+    
+    auto found = m_runs.find(m_lookup);
+    if (found == m_runs.end())
+    {
+        m_mesh_scratch.clear();
+        append_glyphs(m_mesh_scratch, text, size, spacing, glm::vec3(0.0f));
+        
+        TextRun run = { 0, (int) text.size() * 6, 0 };
+        glGenBuffers(1, &run.buffer);
+        g_gl_state.bind_array_buffer(run.buffer);
+        glBufferData(GL_ARRAY_BUFFER, m_mesh_scratch.size() * sizeof(float), m_mesh_scratch.data(), GL_STATIC_DRAW);
+        g_render_stats.bytes_uploaded += m_mesh_scratch.size() * sizeof(float);
+        
+        found = m_runs.emplace(m_lookup, run).first;
+    }
+    else g_gl_state.bind_array_buffer(found->second.buffer);
+    
+    found->second.last_drawn = m_frame;
+    
+    // With the run's buffer bound, the attribute "pointers" are offsets into it
+    draw_vertices(program, model_matrix, (const float *) 0, found->second.vertex_count);
+}
+
+void TextRenderer::queue_hud(const std::string &text, float size, float spacing, glm::vec3 position)
+{
+    append_glyphs(m_hud_vertices, text, size, spacing, position);
+}
+
+void TextRenderer::flush_hud(ShaderProgram *program, const glm::mat4 &model_matrix)
+{
+    if (!m_hud_vertices.empty())
+    {
+        g_gl_state.bind_array_buffer(0);
+        draw_vertices(program, model_matrix, m_hud_vertices.data(), (int) m_hud_vertices.size() / 4);
+        m_hud_vertices.clear();
+    }
+    
+    m_frame++;
+    for (auto entry = m_runs.begin(); entry != m_runs.end();)
+    {
+        if (m_frame - entry->second.last_drawn <= RUN_LIFETIME) { ++entry; continue; }
+        
+        g_gl_state.delete_buffer(entry->second.buffer);
+        entry = m_runs.erase(entry);
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#define GL_SILENCE_DEPRECATION
+#ifdef _WINDOWS
+#include <GL/glew.h>
+#endif
+#define GL_GLEXT_PROTOTYPES 1
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <SDL_opengl.h>
+#include "glm/mat4x4.hpp"
+#include "ShaderProgram.h"
+#include "TextureAtlas.hpp"
+
+// Draws strings from a square bitmap font of fontbank_size x fontbank_size ASCII glyphs.
+// draw() keeps each (text, size, spacing) run as a mesh in its own vertex buffer, built
+// the first time it is drawn and dropped after RUN_LIFETIME frames unused. HUD strings
+// change too often to cache, so queue_hud() appends their glyphs to one client-side
+// array and flush_hud() draws them all in a single call.
+class TextRenderer {
+private:
+    static const unsigned long RUN_LIFETIME = 600;
+    
+    struct RunKey
+    {
+        std::string text;
+        float size;
+        float spacing;
+        
+        bool operator==(const RunKey &other) const { return text == other.text && size == other.size && spacing == other.spacing; }
+    };
+    
+    struct RunKeyHash
+    {
+        size_t operator()(const RunKey &key) const
+        {
+            return std::hash<std::string>()(key.text) ^ (std::hash<float>()(key.size) * 31) ^ (std::hash<float>()(key.spacing) * 131);
+        }
+    };
+    
+    struct TextRun
+    {
+        GLuint buffer;
+        int vertex_count;
+        unsigned long last_drawn;
+    };
+    
+    AtlasRegion m_font;
+    int m_fontbank_size;
+    unsigned long m_frame = 0;
+    
+    std::unordered_map<RunKey, TextRun, RunKeyHash> m_runs;
+    RunKey m_lookup; // Reused so finding a cached run doesn't allocate
+    std::vector<float> m_mesh_scratch;
+    std::vector<float> m_hud_vertices;
+    
+    void append_glyphs(std::vector<float> &vertices, const std::string &text, float size, float spacing, glm::vec3 position);
+    void draw_vertices(ShaderProgram *program, const glm::mat4 &model_matrix, const float *vertices, int vertex_count);
+    
+public:
+    TextRenderer(const AtlasRegion &font, int fontbank_size);
+    ~TextRenderer();
+    
+    // Glyph i of the run is centred at (i * (size + spacing), 0) before the model matrix
+    void draw(ShaderProgram *program, const std::string &text, float size, float spacing, const glm::mat4 &model_matrix);
+    
+    void queue_hud(const std::string &text, float size, float spacing, glm::vec3 position);
+    // Draws everything queued since the last flush and ages the run cache; call once a frame
+    void flush_hud(ShaderProgram *program, const glm::mat4 &model_matrix);
+    
+    int const get_cached_run_count() const { return (int) m_runs.size(); }
+};
@@ -0,0 +1,334 @@
+#include "TextureAtlas.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include "stb_image.h"
+#include "GLState.hpp"
+#include "StartupTimeline.hpp"
+#include "AssetBundle.hpp"
+
+#define LOG(argument) std::cout << argument << '\n'
+
+TextureAtlas::TextureAtlas(int page_size)
+{
+    m_page_size = page_size;
+}
+
+TextureAtlas::~TextureAtlas()
+{
+    stop_decoders();
+    for (Image &image : m_images) stbi_image_free(image.pixels);
+}
+
+void TextureAtlas::release()
+{
+    if (!m_pages.empty()) glDeleteTextures((GLsizei) m_pages.size(), m_pages.data());
+    m_pages.clear();
+}
+
+int TextureAtlas::add(const char *filepath)
+{
+    Image image;
+    image.filepath = filepath;
+    image.pixels = NULL;
+    image.page = -1;
+    
+    m_images.push_back(image);
+    
+    // A bundle already holds the packed pages, so there is nothing to read or decode
+    if (!g_asset_bundle.is_open()) queue_decode(m_images.back());
+    
+    return (int) m_images.size() - 1;
+}
+
+void TextureAtlas::queue_decode(Image &image)
+{
+    // The header alone is enough to lay the image out
+    int number_of_components;
+    if (!stbi_info(image.filepath.c_str(), &image.width, &image.height, &number_of_components))
+    {
+        LOG("Unable to load image. Make sure the path is correct.");
+        assert(false);
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(&image);
+        
+        int decoder_count = (int) std::max(1u, std::thread::hardware_concurrency());
+        if (decoder_count > MAX_DECODERS) decoder_count = MAX_DECODERS;
+        if ((int) m_decoders.size() < decoder_count) m_decoders.emplace_back(&TextureAtlas::decode_images, this);
+    }
+    m_work_ready.notify_one();
+}
+
+void TextureAtlas::decode_images()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_work_ready.wait(lock, [this] { return m_stopping || !m_pending.empty(); });
+        if (m_pending.empty()) return;
+        
+        Image *image = m_pending.front();
+        m_pending.pop_front();
+        lock.unlock();
+        
+        StartupTimeline::TimePoint start = std::chrono::steady_clock::now();
+        int width, height, number_of_components;
+        unsigned char *pixels = stbi_load(image->filepath.c_str(), &width, &height, &number_of_components, STBI_rgb_alpha);
+        g_startup_timeline.record("decode", image->filepath, start, std::chrono::steady_clock::now());
+        
+        lock.lock();
+        image->pixels = pixels;
+        m_decoded.push_back(image);
+        m_image_decoded.notify_one();
+    }
+}
+
+void TextureAtlas::stop_decoders()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_work_ready.notify_all();
+    for (std::thread &decoder : m_decoders) decoder.join();
+    m_decoders.clear();
+}
+
+void TextureAtlas::layout()
+{
+    std::vector<int> order(m_images.size());
+    for (int i = 0; i < (int) order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return m_images[a].height > m_images[b].height; });
+    
+    // Shelves fill left to right; a new shelf opens below the tallest image of the last,
+    // and a new page when the shelf would run off the bottom
+    m_page_sizes.clear();
+    int page = -1, shelf_x = 0, shelf_y = 0, shelf_height = 0;
+    for (int index : order)
+    {
+        Image &image = m_images[index];
+        int padded_width = image.width + 2 * PADDING;
+        int padded_height = image.height + 2 * PADDING;
+        
+        if (page >= 0 && shelf_x + padded_width > m_page_sizes[page])
+        {
+            shelf_x = 0;
+            shelf_y += shelf_height;
+            shelf_height = 0;
+        }
+        if (page < 0 || shelf_y + padded_height > m_page_sizes[page] || padded_width > m_page_sizes[page])
+        {
+            // Oversized images get a page of their own
+            m_page_sizes.push_back(std::max(m_page_size, std::max(padded_width, padded_height)));
+            page++;
+            shelf_x = 0;
+            shelf_y = 0;
+            shelf_height = 0;
+        }
+        
+        image.page = page;
+        image.x = shelf_x + PADDING;
+        image.y = shelf_y + PADDING;
+        shelf_x += padded_width;
+        shelf_height = std::max(shelf_height, padded_height);
+    }
+    
+    m_regions.resize(m_images.size());
+    for (int i = 0; i < (int) m_images.size(); i++)
+    {
+        Image &image = m_images[i];
+        float size = (float) m_page_sizes[image.page];
+        m_regions[i].rect = glm::vec4(image.x / size, image.y / size, image.width / size, image.height / size);
+    }
+}
+
+TextureAtlas::Image *TextureAtlas::next_decoded()
+{
+    Image *image;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_image_decoded.wait(lock, [this] { return !m_decoded.empty(); });
+        image = m_decoded.back();
+        m_decoded.pop_back();
+    }
+    
+    if (image->pixels == NULL)
+    {
+        LOG("Unable to load image. Make sure the path is correct.");
+        assert(false);
+    }
+    return image;
+}
+
+void TextureAtlas::extrude(const Image &image, unsigned char *target, size_t stride)
+{
+    // Copy the rows, then extend each edge outwards into the padding
+    for (int row = -PADDING; row < image.height + PADDING; row++)
+    {
+        int source_row = std::clamp(row, 0, image.height - 1);
+        const unsigned char *source = image.pixels + (size_t) source_row * image.width * 4;
+        unsigned char *line = target + (size_t) (row + PADDING) * stride + PADDING * 4;
+        
+        memcpy(line, source, (size_t) image.width * 4);
+        for (int column = 1; column <= PADDING; column++)
+        {
+            memcpy(line - column * 4, source, 4);
+            memcpy(line + (image.width - 1 + column) * 4, source + (image.width - 1) * 4, 4);
+        }
+    }
+}
+
+static void set_page_parameters()
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+void TextureAtlas::pack()
+{
+    if (g_asset_bundle.is_open())
+    {
+        if (load_bundle()) return;
+        
+        // Stale or damaged, so none of it can be trusted; decode the images after all
+        LOG("The asset bundle doesn't match the images. Re-run --cook; loading from the image files for now.");
+        g_asset_bundle.close();
+        for (Image &image : m_images) queue_decode(image);
+    }
+    
+    layout();
+    
+    // Pages are allocated empty; texels no region covers are never sampled
+    m_pages.resize(m_page_sizes.size());
+    glGenTextures((GLsizei) m_pages.size(), m_pages.data());
+    
+    for (int page_index = 0; page_index < (int) m_pages.size(); page_index++)
+    {
+        int size = m_page_sizes[page_index];
+        g_gl_state.bind_texture(m_pages[page_index]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        set_page_parameters();
+    }
+    
+    for (int i = 0; i < (int) m_images.size(); i++) m_regions[i].texture_id = m_pages[m_images[i].page];
+    
+    // Upload images in whatever order the decoders finish them
+    std::vector<unsigned char> block;
+    for (size_t uploaded = 0; uploaded < m_images.size(); uploaded++)
+    {
+        Image *image = next_decoded();
+        StartupTimeline::TimePoint start = std::chrono::steady_clock::now();
+        
+        int padded_width = image->width + 2 * PADDING;
+        int padded_height = image->height + 2 * PADDING;
+        block.resize((size_t) padded_width * padded_height * 4);
+        extrude(*image, block.data(), (size_t) padded_width * 4);
+        
+        g_gl_state.bind_texture(m_pages[image->page]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, image->x - PADDING, image->y - PADDING, padded_width, padded_height,
+                        GL_RGBA, GL_UNSIGNED_BYTE, block.data());
+        
+        stbi_image_free(image->pixels);
+        image->pixels = NULL;
+        
+        g_startup_timeline.record("upload", image->filepath, start, std::chrono::steady_clock::now());
+    }
+    
+    stop_decoders();
+}
+
+// What a region entry holds; the page is found by name, so only its index is stored
+struct BundledRegion
+{
+    unsigned int page;
+    float rect[4];
+};
+
+static std::string page_name(int page)
+{
+    return "atlas/page" + std::to_string(page);
+}
+
+bool TextureAtlas::cook(AssetBundleWriter &writer)
+{
+    for (size_t decoded = 0; decoded < m_images.size(); decoded++) next_decoded();
+    stop_decoders();
+    
+    layout();
+    
+    // Each page goes in exactly as glTexImage2D wants it, padding and all
+    for (int page_index = 0; page_index < (int) m_page_sizes.size(); page_index++)
+    {
+        int size = m_page_sizes[page_index];
+        std::vector<unsigned char> pixels((size_t) size * size * 4, 0);
+        
+        for (Image &image : m_images)
+        {
+            if (image.page != page_index) continue;
+            extrude(image, &pixels[((size_t) (image.y - PADDING) * size + image.x - PADDING) * 4], (size_t) size * 4);
+        }
+        
+        if (!writer.add(page_name(page_index), AssetBundle::TEXTURE, size, size, pixels.data(), pixels.size())) return false;
+    }
+    
+    for (int i = 0; i < (int) m_images.size(); i++)
+    {
+        BundledRegion region = { (unsigned int) m_images[i].page, { m_regions[i].rect.x, m_regions[i].rect.y, m_regions[i].rect.z, m_regions[i].rect.w } };
+        if (!writer.add(m_images[i].filepath, AssetBundle::REGION, 0, 0, &region, sizeof(region))) return false;
+        
+        stbi_image_free(m_images[i].pixels);
+        m_images[i].pixels = NULL;
+    }
+    return true;
+}
+
+bool TextureAtlas::load_bundle()
+{
+    // Check every page and region before creating anything, so a bad bundle leaves no pages behind
+    unsigned int page_count = 0;
+    for (const AssetBundle::Entry *page; (page = g_asset_bundle.find(page_name(page_count).c_str(), AssetBundle::TEXTURE)) != NULL; page_count++)
+    {
+        if (page->size < (unsigned long long) page->width * page->height * 4) return false;
+    }
+    
+    std::vector<BundledRegion> regions(m_images.size());
+    for (int i = 0; i < (int) m_images.size(); i++)
+    {
+        const AssetBundle::Entry *entry = g_asset_bundle.find(m_images[i].filepath.c_str(), AssetBundle::REGION);
+        if (entry == NULL || entry->size < sizeof(BundledRegion)) return false;
+        
+        memcpy(&regions[i], g_asset_bundle.get_data(entry), sizeof(BundledRegion));
+        if (regions[i].page >= page_count) return false;
+    }
+    
+    // The mapped pixels go to the driver as they are, with no decode or copy in between
+    for (unsigned int page_index = 0; page_index < page_count; page_index++)
+    {
+        const AssetBundle::Entry *entry = g_asset_bundle.find(page_name(page_index).c_str(), AssetBundle::TEXTURE);
+        
+        StartupTimeline::TimePoint start = std::chrono::steady_clock::now();
+        
+        GLuint page;
+        glGenTextures(1, &page);
+        g_gl_state.bind_texture(page);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, entry->width, entry->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, g_asset_bundle.get_data(entry));
+        set_page_parameters();
+        m_pages.push_back(page);
+        
+        g_startup_timeline.record("upload", entry->name, start, std::chrono::steady_clock::now());
+    }
+    
+    m_regions.resize(m_images.size());
+    for (int i = 0; i < (int) m_images.size(); i++)
+    {
+        m_regions[i].texture_id = m_pages[regions[i].page];
+        m_regions[i].rect = glm::vec4(regions[i].rect[0], regions[i].rect[1], regions[i].rect[2], regions[i].rect[3]);
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#define GL_SILENCE_DEPRECATION
+#ifdef _WINDOWS
+#include <GL/glew.h>
+#endif
+#define GL_GLEXT_PROTOTYPES 1
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <SDL_opengl.h>
+#include "glm/vec4.hpp"
+
+class AssetBundleWriter;
+
+// Where an image ended up: its page's texture and its rectangle there in UV space
+// (top-left u, v, then width, height). A UV (u, v) within the original image maps
+// to (rect.x + u * rect.z, rect.y + v * rect.w).
+struct AtlasRegion
+{
+    GLuint texture_id = 0;
+    glm::vec4 rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+};
+
+// Packs images into as few square pages as fit and hands back a region per image.
+// Images are shelf-packed tallest first, each with a border of repeated edge texels so
+// nearest sampling at a region's edge never reads its neighbour.
+//
+// Only the image headers are read up front. The pixels are decoded on a small pool of
+// threads while the caller gets on with other start-up work, and pack() uploads each
+// image into its page as soon as it has been decoded. When g_asset_bundle is open the
+// pages are taken ready-made from it instead, and nothing is decoded at all.
+class TextureAtlas {
+private:
+    static const int PADDING = 2;
+    static const int MAX_DECODERS = 4;
+    
+    struct Image
+    {
+        std::string filepath;
+        int width, height;
+        unsigned char *pixels;
+        int page, x, y;
+    };
+    
+    int m_page_size;
+    std::vector<int> m_page_sizes;
+    // Decoders hold pointers into this, so it must never move its elements
+    std::deque<Image> m_images;
+    std::vector<GLuint> m_pages;
+    std::vector<AtlasRegion> m_regions;
+    
+    // ————— DECODING ————— //
+    std::vector<std::thread> m_decoders;
+    std::mutex m_mutex;
+    std::condition_variable m_work_ready, m_image_decoded;
+    std::deque<Image *> m_pending;
+    std::vector<Image *> m_decoded;
+    bool m_stopping = false;
+    
+    void queue_decode(Image &image);
+    void decode_images();
+    void stop_decoders();
+    Image *next_decoded();
+    
+    // Places every image on a page and works out its region rectangle
+    void layout();
+    // Writes the image and its padding border with its top-left padding texel at target
+    static void extrude(const Image &image, unsigned char *target, size_t stride);
+    // Returns false, having created nothing, if the bundle is missing an image or a page
+    bool load_bundle();
+    
+public:
+    TextureAtlas(int page_size);
+    // Leaves the pages alone; the atlas is a global and outlives the GL context
+    ~TextureAtlas();
+    
+    // Deletes the page textures. Call while the context that packed them is current.
+    void release();
+    
+    // Queues the image for decoding; the returned index is valid in get_region() after pack()
+    int add(const char *filepath);
+    // Needs the GL context. Blocks until every image has been decoded and uploaded.
+    void pack();
+    // Instead of pack(): lays the pages out and adds them and the regions to a bundle.
+    // Needs no GL context. Returns false if an entry couldn't be added.
+    bool cook(AssetBundleWriter &writer);
+    
+    const AtlasRegion &get_region(int image) const { return m_regions[image]; }
+    int const get_page_count() const { return (int) m_pages.size(); }
+};
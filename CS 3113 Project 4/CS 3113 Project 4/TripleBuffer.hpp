@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+
+// Hands values from one producer thread to one consumer thread without locks. The
+// writer fills back() and publishes it; the reader acquires whatever was published
+// last and reads front(). Neither side ever waits on the other: a value the reader
+// never got to is simply replaced by the next one.
+template <typename T>
+class TripleBuffer
+{
+private:
+    // The shared slot index, with FRESH set while it holds a value the reader hasn't taken
+    static const int FRESH = 4;
+    static const int INDEX = 3;
+
+    T m_slots[3];
+    int m_back = 0;
+    int m_front = 2;
+    std::atomic<int> m_middle{1};
+
+    // Published values replaced before the reader acquired them
+    std::atomic<long> m_dropped{0};
+
+public:
+    // ————— WRITER ————— //
+    T &back() { return m_slots[m_back]; }
+
+    void publish()
+    {
+        int previous = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel);
+        if (previous & FRESH) m_dropped.fetch_add(1, std::memory_order_relaxed);
+        m_back = previous & INDEX;
+    }
+
+    // ————— READER ————— //
+    // Returns false, and leaves front() as it was, when nothing new was published
+    bool acquire()
+    {
+        if (!(m_middle.load(std::memory_order_relaxed) & FRESH)) return false;
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    const T &front() const { return m_slots[m_front]; }
+
+    long get_dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+};
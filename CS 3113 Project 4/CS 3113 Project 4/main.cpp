@@ -28,6 +28,17 @@
 #define ENEMY_COUNT 3
 #define LEVEL1_WIDTH 25
 #define LEVEL1_HEIGHT 5
+#define DEFAULT_HEADLESS_TICKS 1000000
+#define VIEW_HALF_WIDTH 5.0f
+#define VIEW_HALF_HEIGHT 3.75f
+#define STATS_INTERVAL 120
+#define DEFAULT_FRAME_RATE 60.0
+#define BACKGROUND_FRAME_RATE 10.0
+#define PARTICLE_CAPACITY 8192
+#define PROJECTILE_CAPACITY 10000
+#define BULLET_SPEED 12.0f
+#define BULLET_LIFETIME 1.5f
+#define ENEMY_DEPTH 0.1f
 
 #ifdef _WINDOWS
 #include <GL/glew.h>
@@ -37,22 +48,45 @@
 #include <SDL_opengl.h>
 #include "glm/mat4x4.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/constants.hpp"
 #include "ShaderProgram.h"
 #include "stb_image.h"
 #include "cmath"
 #include <ctime>
+#include <chrono>
+#include <cstring>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include "Entity.hpp"
 #include "Map.hpp"
+#include "Replay.hpp"
+#include "SpatialGrid.hpp"
+#include "Benchmark.hpp"
+#include "RenderStats.hpp"
+#include "RenderQueue.hpp"
+#include "TextureAtlas.hpp"
+#include "TextRenderer.hpp"
+#include "RenderSnapshot.hpp"
+#include "TripleBuffer.hpp"
+#include "StartupTimeline.hpp"
+#include "AssetBundle.hpp"
+#include "FramePacer.hpp"
+#include "ParticleSystem.hpp"
+#include "ProjectileSystem.hpp"
+#include <fstream>
+#include <sstream>
 using namespace std;
 
 struct GameState
 {
     Entity *player;
     Entity *enemies;
-    Entity *bullet;
+    ProjectileSystem *bullets;
     
     Map *map;
+    SpatialGrid *grid;
 };
 
 const int WINDOW_WIDTH  = 640,
@@ -71,7 +105,10 @@ const int VIEWPORT_X = 0,
 const char GAME_WINDOW_NAME[] = "Rise of the AI";
 
 const char V_SHADER_PATH[] = "shaders/vertex_textured.glsl",
-           F_SHADER_PATH[] = "shaders/fragment_textured.glsl";
+           F_SHADER_PATH[] = "shaders/fragment_textured.glsl",
+           V_INSTANCED_SHADER_PATH[] = "shaders/vertex_instanced.glsl",
+           V_TILEMAP_SHADER_PATH[] = "shaders/vertex_tilemap.glsl",
+           F_TILEMAP_SHADER_PATH[] = "shaders/fragment_tilemap.glsl";
 
 const float MILLISECONDS_IN_SECOND = 1000.0;
 
@@ -82,9 +119,11 @@ const char SPRITESHEET_FILEPATH[] = "assets/images/player.png",
            ENEMY_FILEPATH[] = "assets/images/enemy.png",
            TEXT_SPRITE_FILEPATH[] = "assets/fonts/font1.png";
 
-const int NUMBER_OF_TEXTURES = 1;
-const GLint LEVEL_OF_DETAIL = 0;
-const GLint TEXTURE_BORDER = 0;
+const int ATLAS_PAGE_SIZE = 1024;
+
+// --cook writes this; when it exists the game maps it instead of decoding the PNGs
+const char ASSET_BUNDLE_FILEPATH[] = "assets/assets.bundle",
+           LEVEL_1_NAME[] = "level/1";
 
 unsigned int LEVEL_1_DATA[] =
 {
@@ -98,83 +137,142 @@ unsigned int LEVEL_1_DATA[] =
 GameState g_state;
 
 SDL_Window* m_display_window;
-bool m_game_is_running = true;
+SDL_GLContext g_gl_context = NULL;
+std::atomic<bool> m_game_is_running(true);
+bool g_headless = false;
+int g_enemy_count = ENEMY_COUNT;
 
 ShaderProgram m_program;
-glm::mat4 m_view_matrix, m_projection_matrix, g_text_matrix;
+glm::mat4 m_view_matrix, m_projection_matrix;
+RenderQueue g_render_queue(1);
+// Sprites draw through the instanced shader when the driver has instancing
+ShaderProgram g_instanced_program;
+ShaderProgram *g_sprite_program = &m_program;
+// --tile-texture draws the map as one quad through the tilemap shader instead of its chunk meshes
+bool g_tile_texture = false;
+ShaderProgram g_tilemap_program;
+ShaderProgram *g_map_program = &m_program;
+
+TextureAtlas g_atlas(ATLAS_PAGE_SIZE);
+TextRenderer *g_text = NULL;
 
-GLuint text_texture_id;
+// Dust kicks up under the player on every jump and debris flies from stomped enemies.
+// The simulation only queues bursts; the renderer moves the particles at its own rate.
+ParticleSystem g_particles;
+int g_dust_emitter = -1, g_debris_emitter = -1;
+std::chrono::steady_clock::time_point g_previous_frame;
 
-float m_previous_ticks = 0.0f;
+// Set once loading is done, so the first update() measures from then rather than
+// from whenever the clock's epoch happens to be
+std::chrono::steady_clock::time_point m_previous_ticks;
 float m_accumulator    = 0.0f;
 
 bool double_jump = false;
 int death_count = 0;
 bool mission = false;
+// Shots go the way the player last moved. Left out of the state hash: it only matters
+// through the bullets it aims, and those are hashed.
+float facing = 1.0f;
+
+// Input is sampled once per frame into a bitmask and applied once per tick, so a
+// session can be recorded and replayed tick for tick.
+std::atomic<unsigned char> g_input(0);
+unsigned long long g_state_hash = HASH_SEED;
+Replay g_replay;
+const char *g_record_path = NULL;
+const char *g_timeline_path = NULL;
+
+// --stats prints frame CPU time and renderer counters averaged over STATS_INTERVAL
+// frames; its optional arguments repeat the level's columns to scale the tile count up
+// and add guards.
+bool g_show_stats = false;
+int g_hud_fps = 0;
+int g_level_repeat = 1;
+
+// The simulation runs on its own thread and hands each batch of ticks to the renderer
+// as a snapshot; the main thread polls input and draws whatever was published last.
+TripleBuffer<RenderSnapshot> g_snapshots;
+std::thread g_simulation_thread;
+std::atomic<long> g_simulation_ticks(0);
+std::atomic<long> g_simulation_busy_ns(0);
 
-GLuint load_texture(const char* filepath)
+// Frames are paced to --fps (0 leaves them uncapped), or to the display under --vsync.
+// Windows without focus only redraw at BACKGROUND_FRAME_RATE, and minimised ones not at all.
+FramePacer g_frame_pacer(DEFAULT_FRAME_RATE);
+FramePacer g_background_pacer(BACKGROUND_FRAME_RATE);
+bool g_vsync = false;
+
+// The camera only follows the player's x; enemies outside the view are left out of the
+// snapshot, and the renderer streams the map around the same view
+void publish_snapshot()
 {
-    int width, height, number_of_components;
-    unsigned char* image = stbi_load(filepath, &width, &height, &number_of_components, STBI_rgb_alpha);
-    
-    if (image == NULL)
-    {
-        LOG("Unable to load image. Make sure the path is correct.");
-        assert(false);
-    }
+    RenderSnapshot &snapshot = g_snapshots.back();
+    snapshot.tick = g_simulation_ticks;
+    snapshot.accumulator = m_accumulator;
+    snapshot.camera_x = g_state.player->m_model_matrix[3][0];
+    snapshot.previous_camera_x = g_state.player->m_previous_model_matrix[3][0];
+    snapshot.sprites.clear();
+    snapshot.sprites_culled = 0;
     
-    GLuint texture_id;
-    glGenTextures(NUMBER_OF_TEXTURES, &texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    glTexImage2D(GL_TEXTURE_2D, LEVEL_OF_DETAIL, GL_RGBA, width, height, TEXTURE_BORDER, GL_RGBA, GL_UNSIGNED_BYTE, image);
+    // The renderer may draw the camera anywhere between its last two positions
+    float view_left  = std::min(snapshot.camera_x, snapshot.previous_camera_x) - VIEW_HALF_WIDTH;
+    float view_right = std::max(snapshot.camera_x, snapshot.previous_camera_x) + VIEW_HALF_WIDTH;
     
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    
-    stbi_image_free(image);
+    // Enemies sort over the player, the order they were drawn in before sprites were
+    // batched. Depth only orders sprites that share a texture; the atlas puts them on one page.
+    SpriteSnapshot sprite;
+    if (g_state.player->snapshot(sprite)) snapshot.sprites.push_back(sprite);
+    for (int i = 0; i < g_enemy_count; i++) {
+        if (!g_state.enemies[i].is_in_view(view_left, view_right, VIEW_HALF_HEIGHT, -VIEW_HALF_HEIGHT)) {
+            snapshot.sprites_culled++;
+            continue;
+        }
+        if (!g_state.enemies[i].snapshot(sprite)) continue;
+        sprite.depth += ENEMY_DEPTH;
+        snapshot.sprites.push_back(sprite);
+    }
+    snapshot.sprites_culled += g_state.bullets->snapshot(snapshot.sprites, FIXED_TIMESTEP, view_left, view_right, VIEW_HALF_HEIGHT, -VIEW_HALF_HEIGHT);
     
-    return texture_id;
+    snapshot.game_over = g_state.player->game_over;
+    snapshot.mission = mission;
+    snapshot.bullets_live = g_state.bullets->get_live_count();
+    snapshot.bullets_spawned = g_state.bullets->get_spawned();
+    snapshot.bullets_killed = g_state.bullets->get_killed();
+    snapshot.bullets_dropped = g_state.bullets->get_dropped();
+    snapshot.published = std::chrono::steady_clock::now();
+    // Tiles broken by bullets and bursts go over with the batch of ticks that made them
+    g_state.map->publish_edits();
+    g_particles.publish_bursts();
+    g_snapshots.publish();
 }
 
-void initialise()
+void initialise_level(const AtlasRegion &map_region, const AtlasRegion &player_region, const AtlasRegion &enemy_region)
 {
-    // ————— GENERAL ————— //
-    SDL_Init(SDL_INIT_VIDEO);
-    m_display_window = SDL_CreateWindow(GAME_WINDOW_NAME,
-                                      SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                      WINDOW_WIDTH, WINDOW_HEIGHT,
-                                      SDL_WINDOW_OPENGL);
-    
-    SDL_GLContext context = SDL_GL_CreateContext(m_display_window);
-    SDL_GL_MakeCurrent(m_display_window, context);
-    
-#ifdef _WINDOWS
-    glewInit();
-#endif
-    
-    // ————— VIDEO SETUP ————— //
-    glViewport(VIEWPORT_X, VIEWPORT_Y, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
-    
-    m_program.Load(V_SHADER_PATH, F_SHADER_PATH);
-    
-    m_view_matrix = glm::mat4(1.0f);
-    m_projection_matrix = glm::ortho(-5.0f, 5.0f, -3.75f, 3.75f, -1.0f, 1.0f);
-    
-    m_program.SetProjectionMatrix(m_projection_matrix);
-    m_program.SetViewMatrix(m_view_matrix);
-    
-    g_text_matrix = glm::mat4(1.0f);
-    g_text_matrix = glm::translate(m_view_matrix, glm::vec3(-3.5f, 0.0f, 0.0f));
-    
-    glUseProgram(m_program.programID);
-    
-    glClearColor(BG_RED, BG_BLUE, BG_GREEN, BG_OPACITY);
-    
     // ————— MAP SET-UP ————— //
-    GLuint map_texture_id = load_texture(MAP_TILESET_FILEPATH);
-    g_state.map = new Map(LEVEL1_WIDTH, LEVEL1_HEIGHT, LEVEL_1_DATA, map_texture_id, 1.0f, 12, 13);
+    if (g_headless) {
+        g_state.map = new Map(LEVEL1_WIDTH, LEVEL1_HEIGHT, LEVEL_1_DATA, 1.0f);
+    }
+    else {
+        const unsigned int *level_data = LEVEL_1_DATA;
+        const AssetBundle::Entry *level_entry = g_asset_bundle.find(LEVEL_1_NAME, AssetBundle::LEVEL);
+        if (level_entry != NULL && level_entry->width == LEVEL1_WIDTH && level_entry->height == LEVEL1_HEIGHT)
+        {
+            level_data = (const unsigned int *) g_asset_bundle.get_data(level_entry);
+        }
+        
+        // The map keeps its own copy
+        std::vector<unsigned int> repeated_data(LEVEL1_WIDTH * g_level_repeat * LEVEL1_HEIGHT);
+        for (int y = 0; y < LEVEL1_HEIGHT; y++)
+        {
+            for (int x = 0; x < LEVEL1_WIDTH * g_level_repeat; x++)
+            {
+                repeated_data[y * LEVEL1_WIDTH * g_level_repeat + x] = level_data[y * LEVEL1_WIDTH + x % LEVEL1_WIDTH];
+            }
+        }
+        g_state.map = new Map(LEVEL1_WIDTH * g_level_repeat, LEVEL1_HEIGHT, repeated_data.data(), map_region.texture_id, 1.0f, 12, 13);
+        g_state.map->set_texture(map_region.texture_id, map_region.rect);
+        if (g_map_program == &g_tilemap_program) g_state.map->set_render_mode(Map::TILE_TEXTURE);
+    }
     
     // ————— GEORGE SET-UP ————— //
     // Existing
@@ -184,7 +282,8 @@ void initialise()
     g_state.player->set_movement(glm::vec3(0.0f));
     g_state.player->set_speed(2.5f);
     g_state.player->set_acceleration(glm::vec3(0.0f, -9.81f, 0.0f));
-    g_state.player->m_texture_id = load_texture(SPRITESHEET_FILEPATH);
+    g_state.player->m_texture_id = player_region.texture_id;
+    g_state.player->m_texture_rect = player_region.rect;
     
     // Walking
 //    g_state.player->m_walking[g_state.player->LEFT]  = new int[4] { 1, 5, 9,  13 };
@@ -204,12 +303,12 @@ void initialise()
     // Jumping
     g_state.player->m_jumping_power = 5.0f;
     
-    GLuint enemy_texture_id = load_texture(ENEMY_FILEPATH);
-    g_state.enemies = new Entity[ENEMY_COUNT];
+    g_state.enemies = new Entity[g_enemy_count];
     g_state.enemies[ENEMY_COUNT - 3].set_entity_type(ENEMY);
     g_state.enemies[ENEMY_COUNT - 3].set_ai_type(JUMPER);
     g_state.enemies[ENEMY_COUNT - 3].set_ai_state(RESET);
-    g_state.enemies[ENEMY_COUNT - 3].m_texture_id = enemy_texture_id;
+    g_state.enemies[ENEMY_COUNT - 3].m_texture_id = enemy_region.texture_id;
+    g_state.enemies[ENEMY_COUNT - 3].m_texture_rect = enemy_region.rect;
     g_state.enemies[ENEMY_COUNT - 3].set_position(glm::vec3(2.5f, 3.0f, 0.0f));
     g_state.enemies[ENEMY_COUNT - 3].set_movement(glm::vec3(1.0f));
     g_state.enemies[ENEMY_COUNT - 3].set_speed(0.5f);
@@ -221,7 +320,8 @@ void initialise()
     g_state.enemies[ENEMY_COUNT - 2].set_entity_type(ENEMY);
     g_state.enemies[ENEMY_COUNT - 2].set_ai_type(ASSASSIN);
     g_state.enemies[ENEMY_COUNT - 2].set_ai_state(IDLE);
-    g_state.enemies[ENEMY_COUNT - 2].m_texture_id = enemy_texture_id;
+    g_state.enemies[ENEMY_COUNT - 2].m_texture_id = enemy_region.texture_id;
+    g_state.enemies[ENEMY_COUNT - 2].m_texture_rect = enemy_region.rect;
     g_state.enemies[ENEMY_COUNT - 2].set_position(glm::vec3(20.0f, 0.0f, 0.0f));
     g_state.enemies[ENEMY_COUNT - 2].set_movement(glm::vec3(0.0f));
     g_state.enemies[ENEMY_COUNT - 2].set_speed(1.0f);
@@ -233,7 +333,8 @@ void initialise()
     g_state.enemies[ENEMY_COUNT - 1].set_entity_type(ENEMY);
     g_state.enemies[ENEMY_COUNT - 1].set_ai_type(GUARD);
     g_state.enemies[ENEMY_COUNT - 1].set_ai_state(IDLE);
-    g_state.enemies[ENEMY_COUNT - 1].m_texture_id = enemy_texture_id;
+    g_state.enemies[ENEMY_COUNT - 1].m_texture_id = enemy_region.texture_id;
+    g_state.enemies[ENEMY_COUNT - 1].m_texture_rect = enemy_region.rect;
     g_state.enemies[ENEMY_COUNT - 1].set_position(glm::vec3(12.0f, 0.0f, 0.0f));
     g_state.enemies[ENEMY_COUNT - 1].set_movement(glm::vec3(0.0f));
     g_state.enemies[ENEMY_COUNT - 1].set_speed(0.5f);
@@ -242,16 +343,139 @@ void initialise()
     g_state.enemies[ENEMY_COUNT - 1].set_height(1.0f);
     g_state.enemies[ENEMY_COUNT - 1].set_width(1.0f);
     
-    text_texture_id = load_texture(TEXT_SPRITE_FILEPATH);
+    // Extra guards for stress runs, scattered along the level
+    for (int i = ENEMY_COUNT; i < g_enemy_count; i++) {
+        g_state.enemies[i].set_entity_type(ENEMY);
+        g_state.enemies[i].set_ai_type(GUARD);
+        g_state.enemies[i].set_ai_state(IDLE);
+        g_state.enemies[i].m_texture_id = enemy_region.texture_id;
+        g_state.enemies[i].m_texture_rect = enemy_region.rect;
+        g_state.enemies[i].set_position(glm::vec3(2.0f + (float) ((i * 7919) % 2200) / 100.0f, 1.0f, 0.0f));
+        g_state.enemies[i].set_movement(glm::vec3(0.0f));
+        g_state.enemies[i].set_speed(0.5f);
+        g_state.enemies[i].set_acceleration(glm::vec3(0.0f, -9.81f, 0.0f));
+        g_state.enemies[i].set_height(1.0f);
+        g_state.enemies[i].set_width(1.0f);
+    }
+    
+    g_state.grid = new SpatialGrid(g_state.map->get_tile_size());
+    
+    // ————— BULLET SET-UP ————— //
+    // Drawn with the tileset's dirt tile, shrunk to bullet size
+    g_state.bullets = new ProjectileSystem(PROJECTILE_CAPACITY);
+    g_state.bullets->set_breaks_tiles(true);
+    g_state.bullets->set_texture(map_region.texture_id, glm::vec4(map_region.rect.x + (152 % 12) * map_region.rect.z / 12.0f,
+                                                                  map_region.rect.y + (152 / 12) * map_region.rect.w / 13.0f,
+                                                                  map_region.rect.z / 12.0f, map_region.rect.w / 13.0f));
+}
+
+void free_level()
+{
+    delete    g_state.bullets;
+    delete [] g_state.enemies;
+    delete    g_state.player;
+    delete    g_state.map;
+    delete    g_state.grid;
+}
+
+void initialise()
+{
+    // ————— GENERAL ————— //
+    SDL_Init(SDL_INIT_VIDEO);
+    g_asset_bundle.open(ASSET_BUNDLE_FILEPATH);
+    
+    // Every image shares one atlas page, so a frame binds a single texture. The images
+    // decode on worker threads while the window, context and shaders are set up.
+    int map_image = g_atlas.add(MAP_TILESET_FILEPATH);
+    int player_image = g_atlas.add(SPRITESHEET_FILEPATH);
+    int enemy_image = g_atlas.add(ENEMY_FILEPATH);
+    int text_image = g_atlas.add(TEXT_SPRITE_FILEPATH);
+    
+    StartupTimeline::TimePoint context_start = std::chrono::steady_clock::now();
+    m_display_window = SDL_CreateWindow(GAME_WINDOW_NAME,
+                                      SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                      WINDOW_WIDTH, WINDOW_HEIGHT,
+                                      SDL_WINDOW_OPENGL);
+    
+    g_gl_context = SDL_GL_CreateContext(m_display_window);
+    SDL_GL_MakeCurrent(m_display_window, g_gl_context);
+    g_startup_timeline.record("context", "window and GL context", context_start, std::chrono::steady_clock::now());
+    
+#ifdef _WINDOWS
+    glewInit();
+#endif
+    
+    // ————— VIDEO SETUP ————— //
+    glViewport(VIEWPORT_X, VIEWPORT_Y, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+    
+    // With vsync the swap itself waits for the display, so the pacer stands aside
+    if (g_vsync && SDL_GL_SetSwapInterval(1) == 0)
+    {
+        g_frame_pacer.set_rate(0.0);
+    }
+    else
+    {
+        if (g_vsync) LOG("VSync unavailable; pacing frames to " << g_frame_pacer.get_rate() << " Hz");
+        SDL_GL_SetSwapInterval(0);
+    }
+    
+    m_program.Load(V_SHADER_PATH, F_SHADER_PATH);
+    
+    m_view_matrix = glm::mat4(1.0f);
+    m_projection_matrix = glm::ortho(-VIEW_HALF_WIDTH, VIEW_HALF_WIDTH, -VIEW_HALF_HEIGHT, VIEW_HALF_HEIGHT, -1.0f, 1.0f);
+    
+    m_program.SetProjectionMatrix(m_projection_matrix);
+    m_program.SetViewMatrix(m_view_matrix);
+    
+    if (SDL_GL_ExtensionSupported("GL_ARB_instanced_arrays") && SDL_GL_ExtensionSupported("GL_ARB_draw_instanced"))
+    {
+        g_instanced_program.Load(V_INSTANCED_SHADER_PATH, F_SHADER_PATH);
+        g_instanced_program.SetProjectionMatrix(m_projection_matrix);
+        g_sprite_program = &g_instanced_program;
+    }
+    
+    if (g_tile_texture)
+    {
+        g_tilemap_program.Load(V_TILEMAP_SHADER_PATH, F_TILEMAP_SHADER_PATH);
+        g_tilemap_program.SetProjectionMatrix(m_projection_matrix);
+        g_map_program = &g_tilemap_program;
+    }
+    
+    g_gl_state.use_program(m_program.programID);
+    
+    glClearColor(BG_RED, BG_BLUE, BG_GREEN, BG_OPACITY);
+    
+    // ————— LEVEL SET-UP ————— //
+    g_atlas.pack();
+    
+    initialise_level(g_atlas.get_region(map_image), g_atlas.get_region(player_image), g_atlas.get_region(enemy_image));
+    
+    g_text = new TextRenderer(g_atlas.get_region(text_image), FONTBANK_SIZE);
+    
+    // ————— PARTICLES ————— //
+    // Dust is cut from the tileset's dirt tile; debris is the enemy sprite in miniature
+    AtlasRegion tileset = g_atlas.get_region(map_image);
+    float tile_width = tileset.rect.z / 12.0f, tile_height = tileset.rect.w / 13.0f;
+    ParticleEmitter dust = { tileset.texture_id, tileset.rect.x + (152 % 12) * tile_width, tileset.rect.y + (152 / 12) * tile_height,
+                             tile_width, tile_height, 0.15f, 1.5f, glm::half_pi<float>(), 1.2f, 0.4f, -2.0f };
+    g_dust_emitter = g_particles.add_emitter(dust, PARTICLE_CAPACITY);
+    
+    AtlasRegion enemy = g_atlas.get_region(enemy_image);
+    ParticleEmitter debris = { enemy.texture_id, enemy.rect.x, enemy.rect.y, enemy.rect.z, enemy.rect.w,
+                               0.25f, 4.0f, glm::half_pi<float>(), glm::pi<float>(), 0.8f, -9.81f };
+    g_debris_emitter = g_particles.add_emitter(debris, PARTICLE_CAPACITY);
+    
+    // The first frame draws before the simulation thread has stepped anything
+    publish_snapshot();
     
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    
+    m_previous_ticks = std::chrono::steady_clock::now();
 }
 
 void process_input()
 {
-    g_state.player->set_movement(glm::vec3(0.0f));
-    
     SDL_Event event;
     while (SDL_PollEvent(&event))
     {
@@ -269,16 +493,13 @@ void process_input()
                         break;
                         
                     case SDLK_SPACE:
-                        // Jump
-                        if (g_state.player->m_map_bottom)
-                        {
-                            g_state.player->m_is_jumping = true;
-                            double_jump = true;
-                        }
-                        else if (double_jump == true) {
-                            double_jump = false;
-                            g_state.player->m_is_jumping = true;
-                        }
+                        // Jump; held until the next tick consumes it
+                        g_input |= Replay::INPUT_JUMP;
+                        break;
+                        
+                    case SDLK_f:
+                        // Fire; held until the next tick consumes it, like a jump
+                        g_input |= Replay::INPUT_FIRE;
                         break;
                         
                     default:
@@ -291,16 +512,58 @@ void process_input()
     }
     
     const Uint8 *key_state = SDL_GetKeyboardState(NULL);
-
+    
+    unsigned char held = 0;
     if (key_state[SDL_SCANCODE_LEFT])
+    {
+        held = Replay::INPUT_LEFT;
+    }
+    else if (key_state[SDL_SCANCODE_RIGHT])
+    {
+        held = Replay::INPUT_RIGHT;
+    }
+    
+    // Swap in the held keys without losing a jump or shot the simulation hasn't consumed yet
+    const unsigned char presses = Replay::INPUT_JUMP | Replay::INPUT_FIRE;
+    unsigned char input = g_input;
+    while (!g_input.compare_exchange_weak(input, (input & presses) | held)) {}
+}
+
+void apply_input(unsigned char input)
+{
+    g_state.player->set_movement(glm::vec3(0.0f));
+    
+    if (input & Replay::INPUT_JUMP)
+    {
+        if (g_state.player->m_map_bottom)
+        {
+            g_state.player->m_is_jumping = true;
+            double_jump = true;
+        }
+        else if (double_jump == true) {
+            double_jump = false;
+            g_state.player->m_is_jumping = true;
+        }
+    }
+    
+    if (input & Replay::INPUT_LEFT)
     {
         g_state.player->m_movement.x = -1.0f;
         g_state.player->m_animation_indices = g_state.player->m_walking[g_state.player->LEFT];
+        facing = -1.0f;
     }
-    else if (key_state[SDL_SCANCODE_RIGHT])
+    else if (input & Replay::INPUT_RIGHT)
     {
         g_state.player->m_movement.x = 1.0f;
         g_state.player->m_animation_indices = g_state.player->m_walking[g_state.player->RIGHT];
+        facing = 1.0f;
+    }
+    
+    // Bullets leave from the player's leading edge
+    if (input & Replay::INPUT_FIRE)
+    {
+        glm::vec3 muzzle = g_state.player->get_position() + glm::vec3(facing * g_state.player->get_width() / 2.0f, 0.0f, 0.0f);
+        g_state.bullets->spawn(muzzle.x, muzzle.y, facing * BULLET_SPEED, 0.0f, BULLET_LIFETIME);
     }
     
     // This makes sure that the player can't move faster diagonally
@@ -310,10 +573,62 @@ void process_input()
     }
 }
 
+unsigned long long hash_game_state(unsigned long long hash)
+{
+    hash = g_state.player->hash_state(hash);
+    for (int i = 0; i < g_enemy_count; i++) {
+        hash = g_state.enemies[i].hash_state(hash);
+    }
+    hash = hash_bytes(hash, &double_jump, sizeof(double_jump));
+    hash = hash_bytes(hash, &death_count, sizeof(death_count));
+    hash = hash_bytes(hash, &mission, sizeof(mission));
+    hash = g_state.bullets->hash_state(hash);
+    hash = g_state.map->hash_state(hash);
+    return hash;
+}
+
+void step(unsigned char input)
+{
+    apply_input(input);
+    bool jumped = g_state.player->m_is_jumping;
+    
+    // The player and bullets are the only movers that collide with enemies; bin them once
+    // per tick, and resolve both before the enemies move
+    g_state.grid->rebuild(g_state.enemies, g_enemy_count);
+    g_state.player->update(FIXED_TIMESTEP, g_state.player, g_state.enemies, g_enemy_count, g_state.map, g_state.grid);
+    g_state.bullets->update(FIXED_TIMESTEP, g_state.map, g_state.enemies, g_state.grid);
+    
+    // Enemies only collide with the map, so they can all be integrated in one batch
+    Entity::update_all(FIXED_TIMESTEP, g_state.enemies, g_enemy_count, g_state.player, g_state.map);
+    
+    for (int i = 0; i < g_enemy_count; i++) {
+        if (g_state.enemies[i].get_dead() == true) {
+            death_count += 1;
+        }
+        if (death_count == g_enemy_count) {
+            g_state.player->game_over = true;
+            mission = true;
+        }
+    }
+    if (death_count != g_enemy_count) {
+        death_count = 0;
+    }
+    
+    // Headless runs have no renderer to hand bursts to
+    if (g_headless) return;
+    
+    // Both bursts start at the player's feet: where it left the ground, or what it landed on
+    glm::vec3 feet = g_state.player->get_position() - glm::vec3(0.0f, g_state.player->get_height() / 2.0f, 0.0f);
+    if (jumped) g_particles.burst(g_dust_emitter, feet.x, feet.y, 12);
+    if (g_state.player->m_enemy_bottom) g_particles.burst(g_debris_emitter, feet.x, feet.y, 40);
+}
+
 void update()
 {
-    float ticks = (float)SDL_GetTicks() / MILLISECONDS_IN_SECOND;
-    float delta_time = ticks - m_previous_ticks;
+    // Sub-millisecond, so the simulation thread can sleep right up to the next tick. Only
+    // the difference becomes a float; the time points themselves stay integer.
+    std::chrono::steady_clock::time_point ticks = std::chrono::steady_clock::now();
+    float delta_time = std::chrono::duration<float>(ticks - m_previous_ticks).count();
     m_previous_ticks = ticks;
     
     delta_time += m_accumulator;
@@ -326,150 +641,417 @@ void update()
     if (g_state.player->game_over == false) {
         while (delta_time >= FIXED_TIMESTEP)
         {
-            g_state.player->update(FIXED_TIMESTEP, g_state.player, g_state.enemies, ENEMY_COUNT, g_state.map);
+            unsigned char input = g_input.fetch_and((unsigned char) ~(Replay::INPUT_JUMP | Replay::INPUT_FIRE));
             
-            for (int i = 0; i < ENEMY_COUNT; i++) {
-                g_state.enemies[i].update(FIXED_TIMESTEP, g_state.player, NULL, 0, g_state.map);
-                if (g_state.enemies[i].get_dead() == true) {
-                    death_count += 1;
-                }
-                if (death_count == 3) {
-                    g_state.player->game_over = true;
-                    mission = true;
-                }
-            }
-            if (mission == true) {
-                std::cout << "MISSION SUCCESS" << std::endl;
-            }
-            if (death_count != 3) {
-                death_count = 0;
-            }
-            if (g_state.player->m_enemy_top) {
-                std::cout << "TOP" << std::endl;
-            }
-            if (g_state.player->m_enemy_bottom) {
-                std::cout << "BOTTOM" << std::endl;
+            step(input);
+            g_simulation_ticks++;
+            if (g_record_path != NULL)
+            {
+                g_state_hash = hash_game_state(g_state_hash);
+                g_replay.record(input, g_state_hash);
             }
+            
             delta_time -= FIXED_TIMESTEP;
         }
         m_accumulator = delta_time;
         
-        m_view_matrix = glm::mat4(1.0f);
-        m_view_matrix = glm::translate(m_view_matrix, glm::vec3(-g_state.player->get_position().x, 0.0f, 0.0f));
-        g_text_matrix = glm::mat4(1.0f);
-        g_text_matrix = glm::translate(g_text_matrix, glm::vec3(g_state.player->get_position().x - 3.5, 0.0f, 0.0f));
-        
+        publish_snapshot();
     }
     
 }
 
-void DrawText(ShaderProgram *program, GLuint font_texture_id, string text, float screen_size, float spacing, glm::vec3 position)
+// ————— SIMULATION THREAD ————— //
+// Steps whenever a tick is due and sleeps in between, so a slow swap on the main thread
+// never holds the simulation back and a long batch of ticks never delays a frame.
+void run_simulation()
 {
-    // Scale the size of the fontbank in the UV-plane
-    // We will use this for spacing and positioning
-    float width = 1.0f / FONTBANK_SIZE;
-    float height = 1.0f / FONTBANK_SIZE;
-
-    // Instead of having a single pair of arrays, we'll have a series of pairs—one for each character
-    // Don't forget to include <vector>!
-    vector<float> vertices;
-    vector<float> texture_coordinates;
-
-    // For every character...
-    for (int i = 0; i < text.size(); i++) {
-        // 1. Get their index in the spritesheet, as well as their offset (i.e. their position
-        //    relative to the whole sentence)
-        int spritesheet_index = (int) text[i];  // ascii value of character
-        float offset = (screen_size + spacing) * i;
+    FramePacer pacer(1.0 / FIXED_TIMESTEP);
+    
+    while (m_game_is_running)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        update();
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        g_simulation_busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
         
-        // 2. Using the spritesheet index, we can calculate our U- and V-coordinates
-        float u_coordinate = (float) (spritesheet_index % FONTBANK_SIZE) / FONTBANK_SIZE;
-        float v_coordinate = (float) (spritesheet_index / FONTBANK_SIZE) / FONTBANK_SIZE;
-
-        // 3. Inset the current pair in both vectors
-        vertices.insert(vertices.end(), {
-            offset + (-0.5f * screen_size), 0.5f * screen_size,
-            offset + (-0.5f * screen_size), -0.5f * screen_size,
-            offset + (0.5f * screen_size), 0.5f * screen_size,
-            offset + (0.5f * screen_size), -0.5f * screen_size,
-            offset + (0.5f * screen_size), 0.5f * screen_size,
-            offset + (-0.5f * screen_size), -0.5f * screen_size,
-        });
-
-        texture_coordinates.insert(texture_coordinates.end(), {
-            u_coordinate, v_coordinate,
-            u_coordinate, v_coordinate + height,
-            u_coordinate + width, v_coordinate,
-            u_coordinate + width, v_coordinate + height,
-            u_coordinate + width, v_coordinate,
-            u_coordinate, v_coordinate + height,
-        });
-    }
-
-    // 4. And render all of them using the pairs
-    glm::mat4 model_matrix = glm::mat4(1.0f);
-    g_text_matrix = glm::translate(g_text_matrix, position);
-    
-    program->SetModelMatrix(g_text_matrix);
-    glUseProgram(program->programID);
-    
-    glVertexAttribPointer(program->positionAttribute, 2, GL_FLOAT, false, 0, vertices.data());
-    glEnableVertexAttribArray(program->positionAttribute);
-    glVertexAttribPointer(program->texCoordAttribute, 2, GL_FLOAT, false, 0, texture_coordinates.data());
-    glEnableVertexAttribArray(program->texCoordAttribute);
-    
-    glBindTexture(GL_TEXTURE_2D, font_texture_id);
-    glDrawArrays(GL_TRIANGLES, 0, (int) (text.size() * 6));
-    
-    glDisableVertexAttribArray(program->positionAttribute);
-    glDisableVertexAttribArray(program->texCoordAttribute);
+        // Wake when the banked time reaches a whole tick
+        pacer.wait_until(end + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(FIXED_TIMESTEP - m_accumulator)));
+    }
 }
 
-void render()
+// Only reads the snapshot, the map's tiles and GL state, never the entities. Everything
+// moving is drawn between its last two ticks, by how far the clock has run past the
+// newer one, so motion stays smooth at any display rate.
+void render(const RenderSnapshot &snapshot)
 {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    float elapsed = snapshot.accumulator + std::chrono::duration<float>(now - snapshot.published).count();
+    float alpha = std::min(1.0f, elapsed / FIXED_TIMESTEP);
+    
+    // Particles step by the real frame time, capped so a stall doesn't fling them off
+    float frame_time = g_previous_frame == std::chrono::steady_clock::time_point() ? 0.0f : std::chrono::duration<float>(now - g_previous_frame).count();
+    g_previous_frame = now;
+    g_particles.update(std::min(frame_time, 0.1f));
+    
+    float camera_x = glm::mix(snapshot.previous_camera_x, snapshot.camera_x, alpha);
+    float view_left  = camera_x - VIEW_HALF_WIDTH;
+    float view_right = camera_x + VIEW_HALF_WIDTH;
+    g_state.map->stream(view_left, view_right, VIEW_HALF_HEIGHT, -VIEW_HALF_HEIGHT);
+    
+    m_view_matrix = glm::translate(glm::mat4(1.0f), glm::vec3(-camera_x, 0.0f, 0.0f));
     m_program.SetViewMatrix(m_view_matrix);
+    if (g_sprite_program != &m_program) g_sprite_program->SetViewMatrix(m_view_matrix);
+    if (g_map_program != &m_program) g_map_program->SetViewMatrix(m_view_matrix);
     
     glClear(GL_COLOR_BUFFER_BIT);
     
-    g_state.player->render(&m_program);
-    g_state.map->render(&m_program);
-    for (int i = 0; i < ENEMY_COUNT; i++) {
-        g_state.enemies[i].render(&m_program);
+    g_render_queue.begin();
+    g_render_queue.push_map(0, g_state.map, g_map_program, view_left, view_right);
+    
+    g_render_stats.quads_culled += snapshot.sprites_culled;
+    for (const SpriteSnapshot &sprite : snapshot.sprites) {
+        g_render_queue.push_sprite(0, g_sprite_program, sprite.texture_id, sprite.depth,
+                                   glm::mix(sprite.previous_x, sprite.x, alpha), glm::mix(sprite.previous_y, sprite.y, alpha),
+                                   sprite.scale_x, sprite.scale_y, sprite.uv.x, sprite.uv.y, sprite.uv.z, sprite.uv.w);
     }
+    g_render_queue.push_particles(0, &g_particles, g_sprite_program);
     
-    if (g_state.player->game_over == true) {
-        if (mission == true) {
-            DrawText(&m_program, text_texture_id, "MISSION SUCCESS!", 0.5f, 0.0f, glm::vec3(0.0f, 0.0f, 0.0f));
+    if (snapshot.game_over == true) {
+        glm::mat4 text_matrix = glm::translate(glm::mat4(1.0f), glm::vec3(camera_x - 3.5f, 0.0f, 0.0f));
+        if (snapshot.mission == true) {
+            g_render_queue.push_text(0, g_text, &m_program, "MISSION SUCCESS!", 0.5f, 0.0f, text_matrix);
         }
         else {
-            DrawText(&m_program, text_texture_id, "MISSION FAILED!", 0.5f, 0.0f, glm::vec3(0.0f, 0.0f, 0.0f));
+            g_render_queue.push_text(0, g_text, &m_program, "MISSION FAILED!", 0.5f, 0.0f, text_matrix);
         }
     }
     
+    // HUD text is placed relative to the camera
+    if (g_show_stats) {
+        g_text->queue_hud("FPS " + to_string(g_hud_fps), 0.3f, 0.0f, glm::vec3(-4.7f, 3.45f, 0.0f));
+        g_text->queue_hud("ENEMIES " + to_string(g_enemy_count), 0.3f, 0.0f, glm::vec3(-4.7f, 3.1f, 0.0f));
+    }
+    g_render_queue.push_hud(0, g_text, &m_program, glm::translate(glm::mat4(1.0f), glm::vec3(camera_x, 0.0f, 0.0f)));
+    
+    g_render_queue.sort();
+    g_render_queue.execute();
+    
     SDL_GL_SwapWindow(m_display_window);
 }
 
 void shutdown()
 {
+    // Saved before anything is torn down
+    if (g_record_path != NULL)
+    {
+        if (g_replay.save(g_record_path)) LOG("Recorded " << g_replay.get_tick_count() << " ticks to " << g_record_path);
+        else LOG("Unable to write replay to " << g_record_path);
+    }
+    
+    // The text runs, chunk buffers, index texture and programs are GL objects, so they
+    // go while the context is still current
+    delete g_text;
+    free_level();
+    if (g_headless) return;
+    
+    g_atlas.release();
+    m_program.Cleanup();
+    if (g_sprite_program == &g_instanced_program) g_instanced_program.Cleanup();
+    if (g_map_program == &g_tilemap_program) g_tilemap_program.Cleanup();
+    
+    SDL_GL_DeleteContext(g_gl_context);
     SDL_Quit();
+}
+
+// Prints the time to first frame and, under --timeline, writes every start-up step
+void report_startup()
+{
+    LOG("Startup: first frame after " << g_startup_timeline.elapsed_ms() << " ms; decode " << g_startup_timeline.total_ms("decode")
+        << " ms across threads, upload " << g_startup_timeline.total_ms("upload") << " ms, shaders "
+        << g_startup_timeline.total_ms("compile") + g_startup_timeline.total_ms("link") << " ms, context "
+        << g_startup_timeline.total_ms("context") << " ms");
     
-    delete [] g_state.enemies;
-    delete    g_state.player;
-    delete    g_state.map;
+    if (g_timeline_path == NULL) return;
+    if (g_startup_timeline.write_json(g_timeline_path)) LOG("Wrote start-up timeline to " << g_timeline_path);
+    else LOG("Unable to write start-up timeline to " << g_timeline_path);
+}
+
+// ————— ASSET COOKING ————— //
+// Packs the atlas and gathers the shader sources and level data into one bundle, so
+// later launches map a single file instead of decoding PNGs
+bool cook_assets(const char *filepath)
+{
+    AssetBundleWriter writer;
+    
+    TextureAtlas atlas(ATLAS_PAGE_SIZE);
+    atlas.add(MAP_TILESET_FILEPATH);
+    atlas.add(SPRITESHEET_FILEPATH);
+    atlas.add(ENEMY_FILEPATH);
+    atlas.add(TEXT_SPRITE_FILEPATH);
+    if (!atlas.cook(writer)) return false;
+    
+    const char *shaders[] = { V_SHADER_PATH, F_SHADER_PATH, V_INSTANCED_SHADER_PATH, V_TILEMAP_SHADER_PATH, F_TILEMAP_SHADER_PATH };
+    for (const char *shader : shaders)
+    {
+        std::ifstream file(shader);
+        if (file.fail())
+        {
+            LOG("Unable to read shader " << shader);
+            return false;
+        }
+        std::stringstream source;
+        source << file.rdbuf();
+        if (!writer.add(shader, AssetBundle::SHADER, 0, 0, source.str().data(), source.str().size())) return false;
+    }
+    
+    return writer.add(LEVEL_1_NAME, AssetBundle::LEVEL, LEVEL1_WIDTH, LEVEL1_HEIGHT, LEVEL_1_DATA, sizeof(LEVEL_1_DATA)) &&
+           writer.save(filepath);
+}
+
+// ————— HEADLESS SIMULATION ————— //
+// Drives step() back to back with no window, GL context or textures. Whenever the
+// game ends the level is rebuilt so AI and collision keep getting exercised.
+void simulate_headless(long tick_count)
+{
+    initialise_level(AtlasRegion(), AtlasRegion(), AtlasRegion());
+    
+    int resets = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    for (long tick = 0; tick < tick_count; tick++)
+    {
+        if (g_state.player->game_over == true)
+        {
+            free_level();
+            
+            death_count = 0;
+            mission = false;
+            double_jump = false;
+            facing = 1.0f;
+            
+            initialise_level(AtlasRegion(), AtlasRegion(), AtlasRegion());
+            resets++;
+        }
+        step(0);
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    LOG("Headless: " << tick_count << " ticks in " << seconds << " s (" << (long) (tick_count / seconds) << " ticks/s, "
+        << (tick_count * FIXED_TIMESTEP) / seconds << "x real time), " << resets << " level resets");
+}
+
+// Re-simulates a recorded session headless and checks every tick's state hash.
+// Returns false at the first tick that diverges from the recording.
+bool replay_headless(const char *filepath)
+{
+    Replay replay;
+    if (!replay.load(filepath))
+    {
+        LOG("Unable to read replay " << filepath);
+        return false;
+    }
+    
+    initialise_level(AtlasRegion(), AtlasRegion(), AtlasRegion());
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    
+    for (int tick = 0; tick < replay.get_tick_count(); tick++)
+    {
+        step(replay.get_input(tick));
+        g_state_hash = hash_game_state(g_state_hash);
+        
+        if (g_state_hash != replay.get_hash(tick))
+        {
+            LOG("Replay diverged at tick " << tick << " of " << replay.get_tick_count());
+            return false;
+        }
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    LOG("Replay matched all " << replay.get_tick_count() << " ticks in " << seconds << " s ("
+        << (replay.get_tick_count() * FIXED_TIMESTEP) / seconds << "x real time)");
+    return true;
 }
 
 // ————— GAME LOOP ————— //
 int main(int argc, char* argv[])
 {
+    // --headless [ticks] [enemies] runs the simulation only, as fast as the CPU allows
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+    {
+        g_headless = true;
+        if (argc > 3) g_enemy_count = std::max(ENEMY_COUNT, atoi(argv[3]));
+        simulate_headless(argc > 2 ? atol(argv[2]) : DEFAULT_HEADLESS_TICKS);
+        shutdown();
+        return 0;
+    }
+    
+    // --bench <name> runs one of the micro-benchmarks in Benchmark.cpp
+    if (argc > 2 && strcmp(argv[1], "--bench") == 0)
+    {
+        return run_benchmark(argv[2]) ? 0 : 1;
+    }
+    
+    // --cook [file] writes the asset bundle, by default where the game looks for it
+    if (argc > 1 && strcmp(argv[1], "--cook") == 0)
+    {
+        const char *filepath = argc > 2 ? argv[2] : ASSET_BUNDLE_FILEPATH;
+        bool cooked = cook_assets(filepath);
+        LOG((cooked ? "Cooked assets into " : "Unable to cook assets into ") << filepath);
+        return cooked ? 0 : 1;
+    }
+    
+    // --replay <file> re-simulates a recording headless and verifies its hashes
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0)
+    {
+        g_headless = true;
+        bool matched = replay_headless(argv[2]);
+        shutdown();
+        return matched ? 0 : 1;
+    }
+    
+    // --stats [repeat] [enemies] plays normally and reports per-frame cost, optionally
+    // on a wider level or with extra guards
+    if (argc > 1 && strcmp(argv[1], "--stats") == 0)
+    {
+        g_show_stats = true;
+        if (argc > 2) g_level_repeat = std::max(1, atoi(argv[2]));
+        if (argc > 3) g_enemy_count = std::max(ENEMY_COUNT, atoi(argv[3]));
+    }
+    
+    // --record <file> plays normally and writes the session's inputs and hashes on exit
+    if (argc > 2 && strcmp(argv[1], "--record") == 0)
+    {
+        g_record_path = argv[2];
+    }
+    
+    // --timeline <file> plays normally and writes a trace of start-up to the file
+    if (argc > 2 && strcmp(argv[1], "--timeline") == 0)
+    {
+        g_timeline_path = argv[2];
+    }
+    
+    // Pacing and rendering options may follow any of the modes that open a window
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) g_frame_pacer.set_rate(atof(argv[++i]));
+        else if (strcmp(argv[i], "--vsync") == 0) g_vsync = true;
+        else if (strcmp(argv[i], "--tile-texture") == 0) g_tile_texture = true;
+    }
+    
     initialise();
+    g_simulation_thread = std::thread(run_simulation);
+    bool first_frame = true;
+    
+    int stats_frames = 0;
+    double stats_seconds = 0.0;
+    RenderStats stats_total;
+    std::chrono::steady_clock::time_point stats_start = std::chrono::steady_clock::now();
+    
+    // Thread counters: frames during which the simulation stepped, and how long newly
+    // published snapshots waited from publish until their frame was presented
+    int stats_overlapped = 0, stats_snapshots = 0;
+    double stats_latency = 0.0;
+    long stats_ticks = g_simulation_ticks, stats_busy_ns = g_simulation_busy_ns, stats_dropped = 0;
+    // Process CPU time, summed over every thread
+    clock_t stats_cpu = clock();
     
     while (m_game_is_running)
     {
+        Uint32 window_flags = SDL_GetWindowFlags(m_display_window);
+        if ((window_flags & SDL_WINDOW_MINIMIZED) || !(window_flags & SDL_WINDOW_INPUT_FOCUS))
+        {
+            g_background_pacer.wait();
+            if (window_flags & SDL_WINDOW_MINIMIZED)
+            {
+                process_input();
+                continue;
+            }
+        }
+        else
+        {
+            g_frame_pacer.wait();
+        }
+        
+        std::chrono::steady_clock::time_point frame_start = std::chrono::steady_clock::now();
+        g_render_stats = RenderStats();
+        long ticks_before = g_simulation_ticks;
+        
         process_input();
-        update();
-        render();
+        bool fresh = g_snapshots.acquire();
+        render(g_snapshots.front());
+        
+        if (first_frame)
+        {
+            g_startup_timeline.record("frame", "first frame", frame_start, std::chrono::steady_clock::now());
+            report_startup();
+            first_frame = false;
+        }
+        
+        if (!g_show_stats) continue;
+        
+        std::chrono::steady_clock::time_point frame_end = std::chrono::steady_clock::now();
+        stats_seconds += std::chrono::duration<double>(frame_end - frame_start).count();
+        if (g_simulation_ticks != ticks_before) stats_overlapped++;
+        if (fresh) {
+            stats_snapshots++;
+            stats_latency += std::chrono::duration<double>(frame_end - g_snapshots.front().published).count();
+        }
+        stats_total.draw_calls += g_render_stats.draw_calls;
+        stats_total.quads += g_render_stats.quads;
+        stats_total.quads_culled += g_render_stats.quads_culled;
+        stats_total.bytes_uploaded += g_render_stats.bytes_uploaded;
+        stats_total.gl_calls_issued += g_render_stats.gl_calls_issued;
+        stats_total.gl_calls_elided += g_render_stats.gl_calls_elided;
+        
+        if (++stats_frames == STATS_INTERVAL)
+        {
+            LOG("Frame: " << stats_seconds / stats_frames * 1e3 << " ms CPU, " << stats_total.draw_calls / stats_frames << " draws, "
+                << stats_total.quads / stats_frames << " quads drawn, "
+                << stats_total.quads_culled / stats_frames << " culled, " << stats_total.bytes_uploaded / stats_frames << " bytes uploaded, "
+                << stats_total.gl_calls_issued / stats_frames << " GL state calls issued, " << stats_total.gl_calls_elided / stats_frames << " elided ("
+                << g_state.map->get_width() * g_state.map->get_height() << " map tiles)");
+            
+            double elapsed = std::chrono::duration<double>(frame_end - stats_start).count();
+            long ticks = g_simulation_ticks, busy_ns = g_simulation_busy_ns, dropped = g_snapshots.get_dropped();
+            LOG("Threads: simulation " << (long) ((ticks - stats_ticks) / elapsed) << " ticks/s, " << (busy_ns - stats_busy_ns) * 1e-7 / elapsed
+                << "% busy; render " << (long) (stats_frames / elapsed) << " fps, " << stats_seconds * 100.0 / elapsed << "% busy; "
+                << stats_overlapped * 100 / stats_frames << "% of frames overlapped a tick; "
+                << (stats_snapshots > 0 ? stats_latency / stats_snapshots * 1e3 : 0.0) << " ms publish-to-present; "
+                << stats_snapshots << " snapshots drawn, " << dropped - stats_dropped << " dropped");
+            
+            clock_t cpu = clock();
+            PacingStats pacing = g_frame_pacer.take_stats();
+            LOG("Pacing: target " << (g_frame_pacer.get_rate() > 0.0 ? to_string((int) g_frame_pacer.get_rate()) + " fps" : std::string(g_vsync ? "vsync" : "uncapped"))
+                << ", frame " << pacing.mean_ms << " ms, jitter " << pacing.jitter_ms << " ms (worst " << pacing.worst_ms << " ms); "
+                << (double) (cpu - stats_cpu) / CLOCKS_PER_SEC * 100.0 / elapsed << "% CPU; "
+                << (pacing.frames > 0 ? pacing.slept_ms / pacing.frames : 0.0) << " ms slept, "
+                << (pacing.frames > 0 ? pacing.spun_ms / pacing.frames : 0.0) << " ms spun per frame");
+            stats_cpu = cpu;
+            
+            LOG("Particles: " << g_particles.get_live_count() << " live; " << g_particles.get_spawned() << " spawned, "
+                << g_particles.get_expired() << " expired, " << g_particles.get_dropped() << " dropped in total");
+            const RenderSnapshot &snapshot = g_snapshots.front();
+            LOG("Bullets: " << snapshot.bullets_live << " live; " << snapshot.bullets_spawned << " spawned, " << snapshot.bullets_killed
+                << " killed, " << snapshot.bullets_dropped << " dropped in total");
+            
+            g_hud_fps = (int) (stats_frames / elapsed);
+            stats_start = frame_end;
+            stats_frames = 0;
+            stats_seconds = 0.0;
+            stats_total = RenderStats();
+            stats_overlapped = 0;
+            stats_snapshots = 0;
+            stats_latency = 0.0;
+            stats_ticks = ticks;
+            stats_busy_ns = busy_ns;
+            stats_dropped = dropped;
+        }
     }
     
+    g_simulation_thread.join();
     shutdown();
     return 0;
 }
@@ -0,0 +1,27 @@
+uniform sampler2D diffuse;
+uniform sampler2D tileIndex;
+
+// Map width in tiles, then the index texture's width and height in texels
+uniform vec3 indexLayout;
+// Columns and rows in the tileset, and where it sits in the atlas page
+uniform vec2 tileCount;
+uniform vec4 tilesetRect;
+
+varying vec2 mapCoordVar;
+
+void main() {
+    // Tiles are stored row by row, wrapped onto as many texel rows as they need
+    vec2 cell = floor(mapCoordVar);
+    float index = cell.y * indexLayout.x + cell.x;
+    float row = floor(index / indexLayout.y);
+    vec2 texel = vec2(index - row * indexLayout.y, row) + 0.5;
+    
+    // The id is split over the red and green bytes
+    vec4 encoded = texture2D(tileIndex, texel / indexLayout.yz);
+    float tile = floor(encoded.r * 255.0 + 0.5) + floor(encoded.g * 255.0 + 0.5) * 256.0;
+    if (tile == 0.0) discard;
+    
+    float tileRow = floor(tile / tileCount.x);
+    vec2 uv = (vec2(tile - tileRow * tileCount.x, tileRow) + fract(mapCoordVar)) / tileCount;
+    gl_FragColor = texture2D(diffuse, tilesetRect.xy + uv * tilesetRect.zw);
+}
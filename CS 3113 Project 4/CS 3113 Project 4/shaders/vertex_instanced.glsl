@@ -0,0 +1,20 @@
+attribute vec4 position;
+attribute vec2 texCoord;
+
+// Per instance: centre x, y and scale x, y; then the atlas rectangle's top-left u, v and size
+attribute vec4 instanceRect;
+attribute vec4 instanceUV;
+
+uniform mat4 modelMatrix;
+uniform mat4 viewMatrix;
+uniform mat4 projectionMatrix;
+
+varying vec2 texCoordVar;
+
+void main()
+{
+    vec4 p = vec4(instanceRect.xy + position.xy * instanceRect.zw, position.z, position.w);
+    p = viewMatrix * modelMatrix * p;
+    texCoordVar = instanceUV.xy + texCoord * instanceUV.zw;
+	gl_Position = projectionMatrix * p;
+}
@@ -0,0 +1,17 @@
+attribute vec4 position;
+
+uniform mat4 modelMatrix;
+uniform mat4 viewMatrix;
+uniform mat4 projectionMatrix;
+
+// Left and top edges of the map in world units, then tiles per world unit
+uniform vec3 mapOrigin;
+
+varying vec2 mapCoordVar;
+
+void main()
+{
+    vec4 world = modelMatrix * position;
+    mapCoordVar = vec2(world.x - mapOrigin.x, mapOrigin.y - world.y) * mapOrigin.z;
+	gl_Position = projectionMatrix * viewMatrix * world;
+}